@@ -0,0 +1,508 @@
+#include "async.hpp"
+
+#include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace xml::async {
+event_loop::event_loop() : epoll_fd_{::epoll_create1(EPOLL_CLOEXEC)} {
+  if (epoll_fd_ < 0) {
+    throw std::system_error{errno, std::system_category(), "epoll_create1"};
+  }
+}
+
+event_loop::~event_loop() noexcept { ::close(epoll_fd_); }
+
+void event_loop::watch_(int fd, std::coroutine_handle<> handle) {
+  // one shot, so each wait is a single resumption
+  epoll_event event{};
+  event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+  event.data.ptr = handle.address();
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) != 0 &&
+      (errno != ENOENT ||
+       ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0)) {
+    throw std::system_error{errno, std::system_category(), "epoll_ctl"};
+  }
+  waiting_++;
+}
+
+void event_loop::forget(int fd) noexcept {
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void event_loop::run() {
+  epoll_event events[64];
+  while (waiting_ > 0) {
+    int n = ::epoll_wait(epoll_fd_, events, std::size(events), -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error{errno, std::system_category(), "epoll_wait"};
+    }
+    for (int i = 0; i < n; ++i) {
+      waiting_--;
+      std::coroutine_handle<>::from_address(events[i].data.ptr).resume();
+    }
+  }
+}
+
+source::source(int fd) : fd_{fd} {
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+bool source::fill() {
+  constexpr std::size_t block_size = 1 << 14;
+  bool got_data = false;
+  while (!ended_) {
+    auto size = pending_.size();
+    pending_.resize(size + block_size);
+    auto n = ::read(fd_, pending_.data() + size, block_size);
+    pending_.resize(size + (n > 0 ? static_cast<std::size_t>(n) : 0));
+    if (n > 0) {
+      got_data = true;
+    } else if (n == 0) {
+      ended_ = true;
+    } else if (errno != EINTR) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        ended_ = failed_ = true;
+      }
+      break;
+    }
+  }
+  return got_data;
+}
+
+char_stream source::stream() {
+  // nothing yet, the constructor mustn't block
+  co_yield std::string_view{""};
+  // fill() may add to pending_ while the chunk is being handed over
+  std::string chunk;
+  for (;;) {
+    if (!pending_.empty()) {
+      chunk.swap(pending_);
+      pending_.clear();
+      co_yield chunk;
+    } else if (ended_) {
+      co_return !failed_;
+    } else {
+      // the parser read past what next_event_buffered found buffered
+      assert(false && "parser read ahead of the input");
+      ended_ = failed_ = true;
+    }
+  }
+}
+
+void buffered_text::assign(const char_stream &stream) {
+  pieces_.clear();
+  size_ = piece_ = piece_start_ = 0;
+  stream.for_each_buffered(stream.cursor(), [&](std::string_view piece) {
+    pieces_.push_back(piece);
+    size_ += piece.size();
+  });
+}
+
+std::string_view buffered_text::piece_of_(std::size_t i) const noexcept {
+  // mostly read front to back
+  if (i < piece_start_) {
+    piece_ = piece_start_ = 0;
+  }
+  while (i >= piece_start_ + pieces_[piece_].size()) {
+    piece_start_ += pieces_[piece_++].size();
+  }
+  return pieces_[piece_];
+}
+
+char buffered_text::operator[](std::size_t i) const noexcept {
+  assert(i < size_);
+  return piece_of_(i)[i - piece_start_];
+}
+
+std::size_t buffered_text::find(char c, std::size_t from) const noexcept {
+  while (from < size_) {
+    auto piece = piece_of_(from).substr(from - piece_start_);
+    if (auto p = std::memchr(piece.data(), c, piece.size())) {
+      return from + static_cast<const char *>(p) - piece.data();
+    }
+    from += piece.size();
+  }
+  return std::string::npos;
+}
+
+namespace {
+constexpr auto npos = std::string::npos;
+// Outcomes of a construct besides the position to go on from
+constexpr std::size_t more = npos;
+constexpr std::size_t event = npos - 1;
+
+// The steps of the event parser in xml.hpp, reading the same positions in
+// the same order but only telling whether they are all buffered. Where the
+// parser would ask the stream for more, this gives up.
+class lookahead {
+public:
+  lookahead(const buffered_text &text, const context &ctx,
+            bool namespaces) noexcept
+      : text_{text}, ctx_{ctx}, limits_{ctx.limits}, namespaces_{namespaces} {
+  }
+
+  bool from(const parse_position &position) const noexcept {
+    using step = parse_position::step;
+    if (ctx_.elements.unwinding() != 0) {
+      // the elements an end tag closed are closed without reading
+      return true;
+    }
+    switch (position.at) {
+    case step::markup:
+      return loop_(0, position.depth);
+    case step::content_end:
+      // past the "]]>" of a CDATA section
+      return has_(0) && loop_(text_[0] == '<' ? 0 : 3, position.depth);
+    case step::comment_end:
+      return loop_(3, position.depth);
+    case step::start_tag:
+      return attributes_(0, position.depth, position.attributes);
+    case step::instruction:
+      return instruction_(0);
+    case step::recovery: {
+      auto open = text_.find('<', 0);
+      return open != npos && loop_(open, position.depth);
+    }
+    }
+    return false;
+  }
+
+private:
+  bool has_(std::size_t pos) const noexcept { return pos < text_.size(); }
+
+  template <class F>
+  std::size_t find_if_(std::size_t pos, F &&pred) const noexcept {
+    for (; pos < text_.size(); ++pos) {
+      if (pred(text_[pos])) {
+        return pos;
+      }
+    }
+    return npos;
+  }
+  std::size_t find_word_end_(std::size_t pos) const noexcept {
+    return find_if_(pos, std::not_fn(xml_tag_body));
+  }
+  std::size_t find_non_space_(std::size_t pos) const noexcept {
+    return find_if_(pos, [](char c) { return !isspace(c); });
+  }
+
+  bool matches_(std::string_view pattern, std::size_t pos) const noexcept {
+    if (pos + pattern.size() > text_.size()) {
+      return false;
+    }
+    for (std::size_t i = 0; i < pattern.size(); ++i) {
+      if (text_[pos + i] != pattern[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+  std::size_t find_seq_(std::string_view pattern,
+                        std::size_t pos) const noexcept {
+    for (; (pos = text_.find(pattern[0], pos)) != npos; ++pos) {
+      if (pos + pattern.size() > text_.size()) {
+        return npos;
+      }
+      if (matches_(pattern, pos)) {
+        return pos;
+      }
+    }
+    return npos;
+  }
+
+  bool blank_(std::size_t first, std::size_t last) const noexcept {
+    for (; first < last; ++first) {
+      // the blanks of is_blank
+      if (auto c = text_[first]; c != ' ' && (c < '\t' || c > '\r')) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Just past the closing quote of a value starting at `pos`, like
+  // find_string_end
+  std::size_t string_end_(std::size_t pos) const noexcept {
+    bool escaped = false;
+    for (; has_(pos); ++pos) {
+      char c = text_[pos];
+      if (c == '\\') {
+        escaped = !escaped;
+      } else if (c == '"' && !escaped) {
+        return pos + 1;
+      } else {
+        escaped = false;
+      }
+    }
+    return npos;
+  }
+
+  // parse_tag_content at `depth`, or the loop of parse_xml at 0
+  bool loop_(std::size_t pos, std::size_t depth) const noexcept {
+    for (;;) {
+      if (!has_(pos)) {
+        return false;
+      }
+      auto open = text_.find('<', pos);
+      if (open == npos) {
+        return false;
+      }
+      std::size_t next;
+      if (depth == 0) {
+        next = markup_(open, depth);
+      } else {
+        if (!blank_(pos, open)) {
+          return true;
+        }
+        if (!has_(open + 1)) {
+          return false;
+        }
+        next = text_[open + 1] == '/' ? close_tag_(open + 1)
+                                      : markup_(open, depth);
+      }
+      if (next == event || next == more) {
+        return next == event;
+      }
+      pos = next;
+    }
+  }
+
+  // parse_tag at the '<' at `open`
+  std::size_t markup_(std::size_t open, std::size_t depth) const noexcept {
+    if (!has_(open + 1)) {
+      return more;
+    }
+    if (text_[open + 1] == '?') {
+      auto name = find_if_(open + 1, xml_tag_head);
+      return name == npos || find_word_end_(name + 1) == npos ? more : event;
+    }
+    if (text_[open + 1] == '!') {
+      return declaration_(open + 2);
+    }
+    if (text_[open + 1] == '/') {
+      // an end tag outside every element fails right away
+      return event;
+    }
+    if (depth == limits_.max_depth || ctx_.nodes == limits_.max_nodes) {
+      return event;
+    }
+    auto end = find_word_end_(open + 2);
+    if (end == npos) {
+      return more;
+    }
+    if (end - (open + 1) > limits_.max_name_length || !namespaces_) {
+      return event;
+    }
+    return declarations_(end) ? event : more;
+  }
+
+  // Comments, CDATA sections and declarations, from just past "<!"
+  std::size_t declaration_(std::size_t pos) const noexcept {
+    if (!has_(pos)) {
+      return more;
+    }
+    if (text_[pos] == '-') {
+      if (!has_(pos + 1)) {
+        return more;
+      }
+      if (text_[pos + 1] != '-') {
+        return event;
+      }
+      return find_seq_("-->", pos + 2) == npos ? more : event;
+    }
+    if (text_[pos] == '[') {
+      if (!has_(pos + 7)) {
+        return more;
+      }
+      if (!matches_("[CDATA[", pos)) {
+        return event;
+      }
+      auto end = find_seq_("]]>", pos + 7);
+      if (end == npos) {
+        return more;
+      }
+      if (end != pos + 7) {
+        return event;
+      }
+      return has_(end + 3) ? end + 3 : more;
+    }
+    auto end = declaration_end_(pos);
+    return end == npos || !has_(end) ? more : end;
+  }
+
+  // Like syntax::declaration_end
+  std::size_t declaration_end_(std::size_t pos) const noexcept {
+    std::size_t brackets = 0;
+    for (;; ++pos) {
+      pos = find_if_(pos, [](char c) {
+        return c == '>' || c == '"' || c == '\'' || c == '[' || c == ']' ||
+               c == '<';
+      });
+      if (pos == npos || !has_(pos + 1)) {
+        return npos;
+      }
+      auto c = text_[pos];
+      if (c == '"' || c == '\'') {
+        pos = text_.find(c, pos + 1);
+        if (pos == npos) {
+          return npos;
+        }
+      } else if (c == '[') {
+        brackets++;
+      } else if (c == ']') {
+        brackets -= brackets != 0;
+      } else if (c == '<') {
+        if (!has_(pos + 4)) {
+          return npos;
+        }
+        if (matches_("<!--", pos)) {
+          pos = find_seq_("-->", pos + 4);
+          if (pos == npos) {
+            return npos;
+          }
+          pos += 2;
+        }
+      } else if (brackets == 0) {
+        return pos + 1;
+      }
+    }
+  }
+
+  // syntax::end_tag_name, from the '/' at `slash`
+  std::size_t close_tag_(std::size_t slash) const noexcept {
+    auto name = find_if_(slash, xml_tag_head);
+    return name == npos || find_word_end_(name + 1) == npos ? more : event;
+  }
+
+  // syntax::next_in_start_tag and its attributes, then the content of the
+  // element
+  bool attributes_(std::size_t pos, std::size_t depth,
+                   std::size_t count) const noexcept {
+    if (!has_(pos)) {
+      return false;
+    }
+    pos = find_non_space_(pos);
+    if (pos == npos) {
+      return false;
+    }
+    if (text_[pos] == '>') {
+      return loop_(pos + 1, depth);
+    }
+    if (text_[pos] == '/') {
+      return has_(pos + 1);
+    }
+    return count == limits_.max_attributes || attribute_(pos) == event;
+  }
+
+  // syntax::next_in_instruction and its attributes
+  bool instruction_(std::size_t pos) const noexcept {
+    if (!has_(pos)) {
+      return false;
+    }
+    pos = find_non_space_(pos);
+    if (pos == npos) {
+      return false;
+    }
+    if (text_[pos] == '>') {
+      return true;
+    }
+    if (text_[pos] == '?') {
+      return has_(pos + 1);
+    }
+    return attribute_(pos) == event;
+  }
+
+  // syntax::attribute at the start of the key
+  std::size_t attribute_(std::size_t key) const noexcept {
+    auto key_end = find_word_end_(key + 1);
+    if (key_end == npos) {
+      return more;
+    }
+    if (key_end - key > limits_.max_name_length) {
+      return event;
+    }
+    return after_equals_(key_end) == more ? more : event;
+  }
+
+  // From the end of a key: the end of its quoted value, `event` if there is
+  // no '=' or no quote, `more` if that needs reading
+  std::size_t after_equals_(std::size_t key_end) const noexcept {
+    auto equals = find_non_space_(key_end);
+    if (equals == npos) {
+      return more;
+    }
+    if (text_[equals] != '=') {
+      return event;
+    }
+    if (!has_(equals + 1)) {
+      return more;
+    }
+    auto quote = find_non_space_(equals + 1);
+    if (quote == npos) {
+      return more;
+    }
+    if (text_[quote] != '"') {
+      return event;
+    }
+    if (!has_(quote + 1)) {
+      return more;
+    }
+    auto end = string_end_(quote + 1);
+    return end == npos || !has_(end) ? more : end;
+  }
+
+  // declare_namespaces from the end of the tag name: whether its look at
+  // the attributes stays within the text
+  bool declarations_(std::size_t pos) const noexcept {
+    for (;;) {
+      auto key = find_non_space_(pos);
+      if (key == npos) {
+        return false;
+      }
+      if (!xml_tag_head(text_[key])) {
+        return true;
+      }
+      auto key_end = find_word_end_(key + 1);
+      if (key_end == npos) {
+        return false;
+      }
+      auto equals = find_non_space_(key_end);
+      if (equals == npos) {
+        return false;
+      }
+      if (text_[equals] != '=') {
+        pos = equals;
+        continue;
+      }
+      auto end = after_equals_(key_end);
+      if (end == more || end == event) {
+        return end == event;
+      }
+      pos = end;
+    }
+  }
+
+  const buffered_text &text_;
+  const context &ctx_;
+  const parse_limits &limits_;
+  bool namespaces_;
+};
+} // namespace
+
+bool next_event_buffered(const buffered_text &text,
+                         const parse_position &position, const context &ctx,
+                         bool process_namespaces) noexcept {
+  return lookahead{text, ctx, process_namespaces}.from(position);
+}
+} // namespace xml::async
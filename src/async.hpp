@@ -0,0 +1,239 @@
+#pragma once
+
+#include "char_stream.hpp"
+#include "xml.hpp"
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Parsing many non-blocking sources from a single thread.
+//
+// The parser reads through plain function calls, so it can't be suspended
+// in the middle of an event. Instead, a stream's parser is only resumed once
+// the markup leading to its next event is buffered in full; otherwise the
+// task waits for the descriptor to be readable. What "in full" means is
+// found by following the parser through the buffered text, quotes and
+// processing instructions included, so it never waits inside a read.
+namespace xml::async {
+// Coroutine that starts right away, runs on its own and is destroyed when it
+// finishes
+struct task {
+  struct promise_type {
+    task get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+// epoll based loop resuming the coroutines waiting on descriptors
+class event_loop {
+public:
+  event_loop();
+  event_loop(const event_loop &) = delete;
+  event_loop &operator=(const event_loop &) = delete;
+  ~event_loop() noexcept;
+
+  struct readable_awaiter {
+    event_loop &loop;
+    int fd;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      loop.watch_(fd, handle);
+    }
+    void await_resume() const noexcept {}
+  };
+
+  // co_await loop.readable(fd) resumes once fd has data, or is at its end
+  readable_awaiter readable(int fd) noexcept { return {*this, fd}; }
+
+  // Stops watching fd, before it is closed
+  void forget(int fd) noexcept;
+
+  // Runs until no coroutine is waiting anymore
+  void run();
+
+private:
+  void watch_(int fd, std::coroutine_handle<> handle);
+
+  int epoll_fd_;
+  std::size_t waiting_{0};
+};
+
+// Non-blocking reads from a descriptor, fed to a char_stream
+class source {
+public:
+  // Switches fd to non-blocking mode
+  explicit source(int fd);
+
+  // Takes in whatever can be read without blocking, false if that's nothing
+  bool fill();
+  // At the end of the input or after a failed read
+  bool ended() const noexcept { return ended_; }
+  int fd() const noexcept { return fd_; }
+
+  // Yields what fill() took in. Being asked for more while nothing is
+  // pending ends the input as failed: parse() never lets that happen.
+  char_stream stream();
+
+private:
+  int fd_;
+  std::string pending_;
+  bool ended_{false};
+  bool failed_{false};
+};
+
+// What a stream has buffered from its cursor on, indexed from 0, without
+// copying it
+class buffered_text {
+public:
+  void assign(const char_stream &stream);
+
+  std::size_t size() const noexcept { return size_; }
+  char operator[](std::size_t i) const noexcept;
+  // First `c` from `from` on, npos if there's none
+  std::size_t find(char c, std::size_t from) const noexcept;
+
+private:
+  std::string_view piece_of_(std::size_t i) const noexcept;
+
+  std::vector<std::string_view> pieces_;
+  std::size_t size_{0};
+  // the piece looked at last, and where it starts
+  mutable std::size_t piece_{0};
+  mutable std::size_t piece_start_{0};
+};
+
+// Where the parser stands after its last event, as far as what it reads
+// next goes
+struct parse_position {
+  enum class step : std::uint8_t {
+    // before the next '<' of an element's content or of the document
+    markup,
+    // at the '<' that ended a text event, or at the "]]>" of a CDATA section
+    content_end,
+    // at the "-->" of a comment
+    comment_end,
+    // in a start tag, after its name or an attribute
+    start_tag,
+    // in a processing instruction, after its name or an attribute
+    instruction,
+    // after an error, about to skip to the next '<'
+    recovery,
+  };
+
+  step at{step::markup};
+  // Of the element whose content the parser is in, 0 outside the root
+  std::size_t depth{0};
+  // Of the start tag so far
+  std::size_t attributes{0};
+
+  // Moves past an event, with ctx as the parser left it when emitting it
+  template <class Event>
+  void pass(const Event &, const context &ctx) noexcept {
+    if constexpr (std::is_same_v<Event, tag_open>) {
+      *this = {step::start_tag, ctx.depth, 0};
+    } else if constexpr (std::is_same_v<Event, tag_attribute>) {
+      attributes += at == step::start_tag;
+    } else if constexpr (std::is_same_v<Event, tag_close> ||
+                         std::is_same_v<Event, tag_self_close>) {
+      *this = {step::markup, ctx.depth - 1};
+    } else if constexpr (std::is_same_v<Event, tag_content>) {
+      *this = {step::content_end, ctx.depth};
+    } else if constexpr (std::is_same_v<Event, comment>) {
+      *this = {step::comment_end, ctx.depth};
+    } else if constexpr (std::is_same_v<Event, processing_instruction_begin>) {
+      *this = {step::instruction, ctx.depth};
+    } else if constexpr (std::is_same_v<Event, processing_instruction_end>) {
+      *this = {step::markup, ctx.depth};
+    } else if constexpr (std::is_same_v<Event, parse_error>) {
+      // an end tag that doesn't match is reported without failing a step,
+      // and parsing goes on right after it
+      *this = {ctx.error ? step::recovery : step::markup, ctx.depth};
+    }
+  }
+};
+
+// Whether the parser, at `position` and with its cursor at the start of
+// `text`, gets to its next event without reading past `text`. It is
+// followed through the same reads it makes, so the answer is exact: only
+// reading more could make it wait. Failing counts as an event.
+bool next_event_buffered(const buffered_text &text,
+                         const parse_position &position, const context &ctx,
+                         bool process_namespaces) noexcept;
+
+// Parses fd as it becomes readable, calling handler(event) for each event
+// and then done(const context &) once the document is over. The descriptor
+// is forgotten by the loop but left open.
+template <config Config = config{}, class Handler, class Done>
+task parse(event_loop &loop, int fd, Handler handler, Done done,
+           context ctx = {}) {
+  // every event, so that each tells where the parser stands; the handler
+  // only gets those of Config. Decoding and checking the input are done
+  // here, before the text is first looked at.
+  constexpr config every_event = [] {
+    auto c = Config;
+    c.emit_tag_open = c.emit_tag_close = c.emit_tag_self_close = true;
+    c.emit_tag_attribute = c.emit_tag_content = c.emit_comments = true;
+    c.emit_processing_instruction_begin = true;
+    c.emit_processing_instruction_end = true;
+    c.decode_input = c.validate_utf8 = false;
+    return c;
+  }();
+  using event_type = typename configurable_xml_parser<Config>::event_type;
+
+  source input{fd};
+  auto stream = input.stream();
+  ctx.start(stream);
+  if constexpr (Config.decode_input) {
+    stream.decode_input();
+  }
+  if constexpr (Config.validate_utf8) {
+    stream.check_utf8();
+  }
+  auto parser = parse_xml<every_event>(stream, ctx);
+  parse_position position;
+  buffered_text text;
+  for (;;) {
+    // a stream cut short is over, as far as the parser goes
+    bool ready = input.ended() || stream.overflowed() || stream.malformed();
+    if (!ready) {
+      text.assign(stream);
+      ready = next_event_buffered(text, position, std::as_const(ctx),
+                                  Config.process_namespaces);
+    }
+    if (ready) {
+      if (!parser) {
+        break;
+      }
+      std::visit(
+          [&](const auto &event) {
+            position.pass(event, ctx);
+            if constexpr (std::is_constructible_v<event_type,
+                                                  decltype(event)>) {
+              handler(event_type{event});
+            }
+          },
+          parser.event());
+      continue;
+    }
+    if (input.fill()) {
+      stream.pull();
+    } else if (!input.ended()) {
+      co_await loop.readable(fd);
+    }
+  }
+  loop.forget(fd);
+  done(std::as_const(ctx));
+}
+} // namespace xml::async
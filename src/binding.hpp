@@ -0,0 +1,317 @@
+#pragma once
+
+#include "xml.hpp"
+
+#include <charconv>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+// Fill plain structs straight from the event stream, without building a DOM:
+//
+//   struct item { int id; double price; std::string name; };
+//   struct order { std::string ref; std::vector<item> items; };
+//
+//   constexpr auto item_binding = xml::bind::object<item>(
+//       xml::bind::attribute("id", &item::id),
+//       xml::bind::element("price", &item::price),
+//       xml::bind::element("name", &item::name));
+//   constexpr auto order_binding = xml::bind::object<order>(
+//       xml::bind::attribute("ref", &order::ref),
+//       xml::bind::elements("item", &order::items, item_binding));
+//
+//   auto o = xml::bind::read(stream, order_binding);
+namespace xml::bind {
+
+enum class field_kind { attribute, element, content };
+
+template <class T, class... Fields> struct binding {
+  std::tuple<Fields...> fields;
+};
+
+template <class T, class M> struct attribute_field {
+  constexpr static field_kind kind = field_kind::attribute;
+  std::string_view name;
+  M T::*member;
+};
+
+template <class T, class M> struct content_field {
+  constexpr static field_kind kind = field_kind::content;
+  std::string_view name{};
+  M T::*member;
+};
+
+template <class T, class M> struct value_field {
+  constexpr static field_kind kind = field_kind::element;
+  std::string_view name;
+  M T::*member;
+};
+
+template <class T, class M, class B> struct object_field {
+  constexpr static field_kind kind = field_kind::element;
+  std::string_view name;
+  M T::*member;
+  B binding;
+};
+
+// B is void for a list of values
+template <class T, class M, class B> struct list_field {
+  constexpr static field_kind kind = field_kind::element;
+  std::string_view name;
+  std::vector<M> T::*member;
+  std::conditional_t<std::is_void_v<B>, std::monostate, B> binding{};
+};
+
+template <class T, class... Fields>
+constexpr binding<T, Fields...> object(Fields... fields) {
+  return {{fields...}};
+}
+
+template <class T, class M>
+constexpr attribute_field<T, M> attribute(std::string_view name,
+                                          M T::*member) {
+  return {name, member};
+}
+
+template <class T, class M>
+constexpr content_field<T, M> content(M T::*member) {
+  return {{}, member};
+}
+
+template <class T, class M>
+constexpr value_field<T, M> element(std::string_view name, M T::*member) {
+  return {name, member};
+}
+
+template <class T, class M, class... F>
+constexpr object_field<T, M, binding<M, F...>>
+element(std::string_view name, M T::*member, binding<M, F...> b) {
+  return {name, member, b};
+}
+
+template <class T, class M>
+constexpr list_field<T, M, void> elements(std::string_view name,
+                                          std::vector<M> T::*member) {
+  return {name, member};
+}
+
+template <class T, class M, class... F>
+constexpr list_field<T, M, binding<M, F...>>
+elements(std::string_view name, std::vector<M> T::*member,
+         binding<M, F...> b) {
+  return {name, member, b};
+}
+
+namespace detail {
+constexpr inline config binding_config{
+    .emit_processing_instruction_begin = false,
+    .emit_processing_instruction_end = false,
+};
+using parser_type = configurable_xml_parser<binding_config>;
+
+inline std::string_view trim(std::string_view text) {
+  auto first = text.find_first_not_of(" \t\n\r\f\v");
+  if (first == std::string_view::npos) {
+    return {};
+  }
+  auto last = text.find_last_not_of(" \t\n\r\f\v");
+  return text.substr(first, last - first + 1);
+}
+
+template <class M> bool parse_value(std::string_view text, M &out) {
+  if constexpr (std::is_same_v<M, std::string>) {
+    out.assign(text);
+    return true;
+  } else if constexpr (std::is_same_v<M, bool>) {
+    text = trim(text);
+    if (text == "true" || text == "1") {
+      out = true;
+    } else if (text == "false" || text == "0") {
+      out = false;
+    } else {
+      return false;
+    }
+    return true;
+  } else {
+    static_assert(std::is_arithmetic_v<M>, "unsupported member type");
+    text = trim(text);
+    auto end = text.data() + text.size();
+    auto [ptr, ec] = std::from_chars(text.data(), end, out);
+    return ec == std::errc{} && ptr == end;
+  }
+}
+
+// The helpers below are called right after the tag_open of their element,
+// and return once its tag_close or tag_self_close has been read
+
+inline bool skip_element(parser_type &parser) {
+  size_t depth = 1;
+  while (parser) {
+    auto ev = parser.event();
+    if (std::holds_alternative<tag_open>(ev)) {
+      depth++;
+    } else if (std::holds_alternative<tag_close>(ev) ||
+               std::holds_alternative<tag_self_close>(ev)) {
+      if (--depth == 0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Text directly inside the element, nested elements are skipped
+inline bool read_text(parser_type &parser, std::string &text) {
+  while (parser) {
+    auto ev = parser.event();
+    if (auto *content = std::get_if<tag_content>(&ev)) {
+      text += content->content;
+    } else if (std::holds_alternative<tag_open>(ev)) {
+      if (!skip_element(parser)) {
+        return false;
+      }
+    } else if (std::holds_alternative<tag_close>(ev) ||
+               std::holds_alternative<tag_self_close>(ev)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <class M> bool read_value(parser_type &parser, M &out) {
+  std::string text;
+  return read_text(parser, text) && parse_value(trim(text), out);
+}
+
+template <class T, class... F>
+bool fill(parser_type &parser, const binding<T, F...> &b, T &out);
+
+template <class T, class M>
+bool read_element(parser_type &parser, const value_field<T, M> &field,
+                  T &out) {
+  return read_value(parser, out.*field.member);
+}
+
+template <class T, class M, class B>
+bool read_element(parser_type &parser, const object_field<T, M, B> &field,
+                  T &out) {
+  return fill(parser, field.binding, out.*field.member);
+}
+
+template <class T, class M, class B>
+bool read_element(parser_type &parser, const list_field<T, M, B> &field,
+                  T &out) {
+  auto &item = (out.*field.member).emplace_back();
+  if constexpr (std::is_void_v<B>) {
+    return read_value(parser, item);
+  } else {
+    return fill(parser, field.binding, item);
+  }
+}
+
+// Calls func on each field of kind K until one returns true
+template <field_kind K, class... F, class Func>
+bool find_field(const std::tuple<F...> &fields, Func &&func) {
+  return std::apply(
+      [&](const auto &...field) {
+        return ([&](const auto &f) {
+          if constexpr (std::remove_cvref_t<decltype(f)>::kind == K) {
+            return func(f);
+          } else {
+            return false;
+          }
+        }(field) || ...);
+      },
+      fields);
+}
+
+template <class T, class... F>
+bool fill(parser_type &parser, const binding<T, F...> &b, T &out) {
+  constexpr bool has_content = ((F::kind == field_kind::content) || ...);
+  std::string text;
+
+  while (parser) {
+    auto ev = parser.event();
+    bool ok = true;
+
+    if (auto *attr = std::get_if<tag_attribute>(&ev)) {
+      find_field<field_kind::attribute>(b.fields, [&](const auto &field) {
+        if (field.name != attr->key) {
+          return false;
+        }
+        ok = parse_value(attr->value, out.*field.member);
+        return true;
+      });
+    } else if (auto *open = std::get_if<tag_open>(&ev)) {
+      bool known =
+          find_field<field_kind::element>(b.fields, [&](const auto &field) {
+            if (field.name != open->name) {
+              return false;
+            }
+            ok = read_element(parser, field, out);
+            return true;
+          });
+      if (!known) {
+        ok = skip_element(parser);
+      }
+    } else if (auto *content = std::get_if<tag_content>(&ev)) {
+      if constexpr (has_content) {
+        text += content->content;
+      }
+    } else {
+      if constexpr (has_content) {
+        find_field<field_kind::content>(b.fields, [&](const auto &field) {
+          ok = parse_value(trim(text), out.*field.member);
+          return true;
+        });
+      }
+      return ok;
+    }
+
+    if (!ok) {
+      return false;
+    }
+  }
+  return false;
+}
+} // namespace detail
+
+// Reads the first element of the stream into a T
+template <class T, class... F>
+std::optional<T> read(char_stream &stream, const binding<T, F...> &b) {
+  auto parser = parse_xml<detail::binding_config>(stream);
+  while (parser) {
+    if (std::holds_alternative<tag_open>(parser.event())) {
+      T out{};
+      if (!detail::fill(parser, b, out)) {
+        return std::nullopt;
+      }
+      return out;
+    }
+  }
+  return std::nullopt;
+}
+
+// Reads every element named `name`, at any depth, and hands it to `func` as
+// soon as it is complete. Returns false if an element couldn't be read.
+template <class T, class... F, class Func>
+bool read_each(char_stream &stream, std::string_view name,
+               const binding<T, F...> &b, Func &&func) {
+  auto parser = parse_xml<detail::binding_config>(stream);
+  while (parser) {
+    auto ev = parser.event();
+    if (auto *open = std::get_if<tag_open>(&ev); open && open->name == name) {
+      T out{};
+      if (!detail::fill(parser, b, out)) {
+        return false;
+      }
+      func(std::move(out));
+    }
+  }
+  return true;
+}
+} // namespace xml::bind
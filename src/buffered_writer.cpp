@@ -0,0 +1,48 @@
+#include "buffered_writer.hpp"
+
+#include <cerrno>
+#include <unistd.h>
+
+buffered_writer::buffered_writer(int fd, std::size_t capacity)
+    : fd_{fd}, capacity_{capacity == 0 ? 1 : capacity},
+      buffer_{new char[capacity_]} {}
+
+buffered_writer::~buffered_writer() noexcept { flush(); }
+
+bool buffered_writer::flush() noexcept {
+  if (size_ > 0) {
+    write_all_(buffer_.get(), size_);
+    size_ = 0;
+  }
+  return good();
+}
+
+bool buffered_writer::reset(int fd) noexcept {
+  bool result = flush();
+  fd_ = fd;
+  failed_ = false;
+  return result;
+}
+
+void buffered_writer::write_slow_(std::string_view data) noexcept {
+  flush();
+  if (data.size() >= capacity_) {
+    write_all_(data.data(), data.size());
+  } else {
+    std::memcpy(buffer_.get(), data.data(), data.size());
+    size_ = data.size();
+  }
+}
+
+bool buffered_writer::write_all_(const char *data, std::size_t size) noexcept {
+  while (size > 0 && !failed_) {
+    auto n = ::write(fd_, data, size);
+    if (n < 0) {
+      failed_ = errno != EINTR;
+      continue;
+    }
+    data += n;
+    size -= static_cast<std::size_t>(n);
+  }
+  return !failed_;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+// Accumulates output in a large buffer and hands it to a file descriptor in
+// big writes. Writes bigger than the buffer bypass it.
+class buffered_writer {
+public:
+  constexpr static std::size_t default_capacity = 1 << 16;
+
+  explicit buffered_writer(int fd, std::size_t capacity = default_capacity);
+  buffered_writer(const buffered_writer &) = delete;
+  buffered_writer &operator=(const buffered_writer &) = delete;
+  ~buffered_writer() noexcept;
+
+  void write(std::string_view data) noexcept {
+    if (data.size() <= capacity_ - size_) {
+      std::memcpy(buffer_.get() + size_, data.data(), data.size());
+      size_ += data.size();
+    } else {
+      write_slow_(data);
+    }
+  }
+
+  void put(char c) noexcept {
+    if (size_ == capacity_) {
+      flush();
+    }
+    buffer_[size_++] = c;
+  }
+
+  // Sends everything buffered so far, returns false once a write failed
+  bool flush() noexcept;
+
+  // Flushes, then sends the following output to another descriptor
+  bool reset(int fd) noexcept;
+
+  bool good() const noexcept { return !failed_; }
+
+private:
+  void write_slow_(std::string_view data) noexcept;
+  bool write_all_(const char *data, std::size_t size) noexcept;
+
+  int fd_;
+  std::size_t capacity_;
+  std::size_t size_{0};
+  std::unique_ptr<char[]> buffer_;
+  bool failed_{false};
+};
@@ -1,5 +1,93 @@
 #include "char_stream.hpp"
 
+#include <functional>
+
+void chunk_buffer::append(std::string_view data) {
+  while (!data.empty()) {
+    auto offset = end_ % chunk_size;
+    if (offset == 0 && end_ / chunk_size - first_chunk_ == chunks_.size()) {
+      auto &chunk = chunks_.emplace_back(
+          std::make_shared_for_overwrite<char[]>(chunk_size));
+      by_address_.emplace(chunk.get(), std::pair{end_, chunk_size});
+    }
+    auto n = std::min(data.size(), chunk_size - offset);
+    std::memcpy(chunks_.back().get() + offset, data.data(), n);
+    end_ += n;
+    data.remove_prefix(n);
+  }
+}
+
+std::string_view chunk_buffer::spill_(size_t first, size_t last) {
+  // a copy holding the range starts in the same chunk, unless it is a long
+  // one from further back, which isn't worth looking for
+  auto after = std::ranges::upper_bound(spills_, first, {}, &spill::first);
+  auto chunk_start = first - first % chunk_size;
+  for (auto it = after; it != spills_.begin() && (it - 1)->first >= chunk_start;
+       --it) {
+    auto &s = *(it - 1);
+    if (last <= s.last) {
+      return {s.data.get() + (first - s.first), last - first};
+    }
+  }
+  auto data = std::make_shared_for_overwrite<char[]>(last - first);
+  for (auto pos = first; pos < last;) {
+    auto part = piece(pos).substr(0, last - pos);
+    std::memcpy(data.get() + (pos - first), part.data(), part.size());
+    pos += part.size();
+  }
+  by_address_.emplace(data.get(), std::pair{first, last - first});
+  auto &s = *spills_.insert(after, spill{first, last, std::move(data)});
+  return {s.data.get(), last - first};
+}
+
+size_t chunk_buffer::position_of(const char *ptr) const noexcept {
+  std::less_equal<const char *> le;
+  // views are mostly of what was read last
+  if (!chunks_.empty()) {
+    auto chunk = chunks_.back().get();
+    if (le(chunk, ptr) && le(ptr, chunk + chunk_size)) {
+      return (first_chunk_ + chunks_.size() - 1) * chunk_size + (ptr - chunk);
+    }
+  }
+  // the chunk or spill starting last at or before ptr, if ptr is inside
+  if (auto it = by_address_.upper_bound(ptr); it != by_address_.begin()) {
+    auto [start, pos_size] = *std::prev(it);
+    auto [pos, size] = pos_size;
+    if (le(ptr, start + size)) {
+      return pos + (ptr - start);
+    }
+  }
+  // empty views that point nowhere
+  return end_;
+}
+
+void chunk_buffer::discard_before(size_t pos) noexcept {
+  assert(pos <= end_);
+  while (!chunks_.empty() && (first_chunk_ + 1) * chunk_size <= pos) {
+    by_address_.erase(chunks_.front().get());
+    chunks_.erase(chunks_.begin());
+    first_chunk_++;
+  }
+  auto freed = std::ranges::lower_bound(spills_, begin(), {}, &spill::first);
+  for (auto it = spills_.begin(); it != freed; ++it) {
+    by_address_.erase(it->data.get());
+  }
+  spills_.erase(spills_.begin(), freed);
+}
+
+void chunk_buffer::share_from(
+    size_t first, std::vector<std::shared_ptr<const char[]>> &owners) const {
+  assert(first >= begin());
+  for (auto i = first / chunk_size - first_chunk_; i < chunks_.size(); ++i) {
+    owners.push_back(chunks_[i]);
+  }
+  for (auto &s : spills_) {
+    if (s.last > first) {
+      owners.push_back(s.data);
+    }
+  }
+}
+
 char_stream slurp_file(const char *filename) {
   constexpr auto BUFFER_SIZE = 1024;
 
@@ -26,3 +114,8 @@ char_stream slurp_file(const char *filename) {
 
   co_return true;
 }
+
+char_stream read_string(std::string_view data) {
+  co_yield data;
+  co_return true;
+}
@@ -1,14 +1,23 @@
 #pragma once
 
 #include "common.hpp"
+#include "simd.hpp"
+#include "transcode.hpp"
+#include "utf8.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <coroutine>
 #include <cstring>
 #include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 namespace detail {
 template <class T>
@@ -22,22 +31,96 @@ concept MultiSearchable = requires(T obj) {
 };
 } // namespace detail
 
-// Buffered stream of chars, may or may not be finite, but better be
-struct char_stream {
+// Storage of a char_stream: fixed size chunks that are never moved once
+// allocated, so appending leaves every view into them valid. A view that
+// spans two chunks is a copy, which is kept along with the chunks.
+class chunk_buffer {
+public:
+  constexpr static size_t chunk_size = size_t{1} << 16;
+
+  chunk_buffer() = default;
+  chunk_buffer(const chunk_buffer &) = delete;
+  chunk_buffer &operator=(const chunk_buffer &) = delete;
+  // Assigning an empty buffer starts over at position 0
+  chunk_buffer &operator=(chunk_buffer &&) = default;
+
+  // Position of the first char still held
+  size_t begin() const noexcept { return first_chunk_ * chunk_size; }
+  // Position past the last char
+  size_t end() const noexcept { return end_; }
+  size_t size() const noexcept { return end_ - begin(); }
+
+  // The char at `pos`, or '\0' past the end
+  char at(size_t pos) const noexcept {
+    assert(pos >= begin());
+    if (pos >= end_) {
+      return '\0';
+    }
+    return chunks_[pos / chunk_size - first_chunk_][pos % chunk_size];
+  }
 
-  struct overwriter {
-    size_t size;
-    const char *buf;
-    size_t read_bytes;
+  // The chars from `pos` to the end of its chunk or of the buffer
+  std::string_view piece(size_t pos) const noexcept {
+    assert(pos >= begin() && pos <= end_);
+    auto index = pos / chunk_size - first_chunk_;
+    if (index == chunks_.size()) {
+      return {};
+    }
+    auto chunk_end = std::min(end_, (pos / chunk_size + 1) * chunk_size);
+    return {chunks_[index].get() + pos % chunk_size, chunk_end - pos};
+  }
 
-    inline auto operator()(char *ptr, [[maybe_unused]] size_t count) const
-        -> size_t {
-      assert(size + read_bytes <= count);
-      memcpy(ptr + size, buf, read_bytes);
-      return size + read_bytes;
+  // Contiguous view of [first, last)
+  std::string_view view(size_t first, size_t last) {
+    assert(first >= begin() && first <= last && last <= end_);
+    if (first == last || first / chunk_size == (last - 1) / chunk_size) {
+      return piece(first).substr(0, last - first);
     }
+    return spill_(first, last);
+  }
+
+  void append(std::string_view data);
+  // Drops what comes from `pos` on
+  void truncate(size_t pos) noexcept {
+    assert(pos >= begin() && pos <= end_);
+    end_ = pos;
+  }
+
+  // Position of a char that a view returned by the buffer points to
+  size_t position_of(const char *ptr) const noexcept;
+
+  // Frees the chunks that lie wholly before `pos`, and the copies made
+  // from them, unless they are shared
+  void discard_before(size_t pos) noexcept;
+
+  // Adds to `owners` the chunks and copies holding anything from `first`
+  // on. Views into them stay valid for as long as `owners` holds them,
+  // discarded or not.
+  void share_from(size_t first,
+                  std::vector<std::shared_ptr<const char[]>> &owners) const;
+
+private:
+  struct spill {
+    size_t first;
+    size_t last;
+    std::shared_ptr<char[]> data;
   };
 
+  std::string_view spill_(size_t first, size_t last);
+
+  // chunks_[i] holds the chars from (first_chunk_ + i) * chunk_size on
+  std::vector<std::shared_ptr<char[]>> chunks_;
+  size_t first_chunk_{0};
+  size_t end_{0};
+  // in position order, so discarding frees a prefix
+  std::vector<spill> spills_;
+  // position and size of every chunk and spill, by address
+  std::map<const char *, std::pair<size_t, size_t>, std::less<>> by_address_;
+};
+
+// Buffered stream of chars, may or may not be finite, but better be
+struct char_stream {
+
   struct promise_type;
   using handle_type = std::coroutine_handle<promise_type>;
 
@@ -45,6 +128,10 @@ struct char_stream {
     reading,
     failed,
     eof,
+    // the producer went over the buffer limit
+    overflow,
+    // the input isn't valid UTF-8, see check_utf8
+    malformed,
   };
 
   struct promise_type {
@@ -57,34 +144,107 @@ struct char_stream {
     void unhandled_exception() noexcept { std::terminate(); }
 
     void return_value(bool success) noexcept {
+      if (success && decoder_) {
+        take(decoder_->finish());
+      }
+      end_input(success);
+    }
+
+    // The producer goes on right away when the decoder held back all it was
+    // given, while it sniffs the encoding: the reader only resumes it when
+    // it needs more. An empty yield still suspends, producers use it to
+    // return before they have anything.
+    struct yield_awaiter {
+      bool go_on;
+      bool await_ready() const noexcept { return go_on; }
+      void await_suspend(std::coroutine_handle<>) const noexcept {}
+      void await_resume() const noexcept {}
+    };
+
+    yield_awaiter yield_value(std::string_view sv) {
+      if (!decoder_) {
+        take(sv);
+        return {false};
+      }
+      auto end = buffer_.end();
+      take(decoder_->feed(sv));
+      return {!sv.empty() && buffer_.end() == end &&
+              status_ == status::reading};
+    }
+
+    // Once the producer is done, unless reading already stopped
+    void end_input(bool success) noexcept {
+      if (status_ != status::reading) {
+        return;
+      }
       status_ = success ? status::eof : status::failed;
+      if (success && check_utf8_) {
+        reject_utf8(utf8_.finish());
+      }
     }
 
-    std::suspend_always yield_value(std::string_view sv) {
+    // Buffers what the producer delivered, after decoding
+    void take(std::string_view sv) {
+      if (sv.size() > max_size_ - buffer_.size()) {
+        status_ = status::overflow;
+        return;
+      }
+      if (check_utf8_) {
+        if (auto bad = utf8_.feed(sv); bad != utf8_validator::npos) {
+          if (bad > buffer_.end()) {
+            buffer_.append(sv.substr(0, bad - buffer_.end()));
+          }
+          reject_utf8(bad);
+          return;
+        }
+      }
 
-      buffer_.resize_and_overwrite(buffer_.size() + sv.size(),
-                                   overwriter{.size = buffer_.size(),
-                                              .buf = sv.data(),
-                                              .read_bytes = sv.size()});
+      buffer_.append(sv);
+    }
 
-      return {};
+    // Ends the input just before `bad`, unless it's npos
+    void reject_utf8(size_t bad) noexcept {
+      if (bad != utf8_validator::npos) {
+        buffer_.truncate(bad);
+        status_ = status::malformed;
+      }
     }
 
     status status_{status::reading};
 
-    std::string buffer_;
+    chunk_buffer buffer_;
+    size_t max_size_{std::string::npos};
+
+    bool check_utf8_{false};
+    utf8_validator utf8_;
+    std::optional<input_decoder> decoder_;
   };
 
   explicit(false) char_stream(handle_type h) noexcept
       : handle_{h}, current_{0} {}
+  // Stream over `text` itself, which must outlive it. There's no producer
+  // and nothing is copied: the whole input is there from the start, so
+  // searches run straight over it and never wait for more. Buffer limits
+  // don't apply and discarding does nothing.
+  explicit char_stream(std::string_view text) noexcept
+      : handle_{nullptr}, current_{0}, text_{text}, borrowed_{true} {}
   char_stream(const char_stream &other) = delete;
   char_stream(char_stream &&other) noexcept
       : handle_{std::exchange(other.handle_, nullptr)},
-        current_{other.current_} {}
+        current_{other.current_}, text_{other.text_},
+        borrowed_{other.borrowed_}, malformed_{other.malformed_},
+        decoded_{std::move(other.decoded_)} {}
   char_stream &operator=(const char_stream &other) = delete;
   char_stream &operator=(char_stream &&other) noexcept {
+    if (handle_ != nullptr) {
+      handle_.destroy();
+    }
     this->handle_ = std::exchange(other.handle_, nullptr);
     this->current_ = other.current_;
+    this->text_ = other.text_;
+    this->borrowed_ = other.borrowed_;
+    this->malformed_ = other.malformed_;
+    this->decoded_ = std::move(other.decoded_);
     return *this;
   }
   ~char_stream() noexcept {
@@ -94,10 +254,100 @@ struct char_stream {
   }
 
   size_t cursor() const noexcept { return current_; }
+
+  // Stops reading, as if the input ended, once more than `max_bytes` would
+  // be buffered. Only applies to what is read from then on.
+  void limit_buffer(size_t max_bytes) noexcept {
+    if (!borrowed_) {
+      p_().max_size_ = max_bytes;
+    }
+  }
+  bool overflowed() const noexcept {
+    assert(valid_());
+    return !borrowed_ && p_().status_ == status::overflow;
+  }
+
+  // Converts the input to UTF-8 from the encoding its byte order mark or
+  // XML declaration gives, see input_decoder. Must come before anything is
+  // read, and before check_utf8. Positions are then those of the UTF-8.
+  void decode_input() {
+    assert(valid_());
+    assert(current_ == 0);
+    if (borrowed_) {
+      size_t bom_size;
+      if (sniff_encoding(text_, true, bom_size) == text_encoding::utf8) {
+        text_.remove_prefix(bom_size);
+        return;
+      }
+      input_decoder decoder;
+      auto decoded = std::make_unique<std::string>(decoder.feed(text_));
+      decoded->append(decoder.finish());
+      decoded_ = std::move(decoded);
+      text_ = *decoded_;
+      return;
+    }
+    auto &p = p_();
+    if (p.decoder_ || (p.status_ != status::reading &&
+                       p.status_ != status::eof)) {
+      return;
+    }
+    // what's already there goes through the decoder first
+    std::string read;
+    for_each_buffered(0, [&](std::string_view piece) { read += piece; });
+    p.buffer_ = {};
+    auto ended = p.status_ == status::eof;
+    p.status_ = status::reading;
+    p.decoder_.emplace();
+    p.take(p.decoder_->feed(read));
+    if (ended) {
+      p.take(p.decoder_->finish());
+      p.end_input(true);
+    }
+  }
+
+  // Stops reading, as if the input ended, before the first byte that isn't
+  // part of well-formed UTF-8, and sets malformed(). What's already
+  // buffered is checked right away, the rest as the producer delivers it.
+  void check_utf8() noexcept {
+    assert(valid_());
+    if (borrowed_) {
+      if (auto bad = find_invalid_utf8(text_); bad != utf8_validator::npos) {
+        text_ = text_.substr(0, bad);
+        malformed_ = true;
+      }
+      return;
+    }
+    auto &p = p_();
+    if (p.check_utf8_ || (p.status_ != status::reading &&
+                          p.status_ != status::eof)) {
+      return;
+    }
+    p.check_utf8_ = true;
+    p.utf8_ = utf8_validator{front_()};
+    for (auto pos = front_(); pos < end_();) {
+      auto piece = piece_(pos);
+      if (auto bad = p.utf8_.feed(piece); bad != utf8_validator::npos) {
+        p.reject_utf8(bad);
+        return;
+      }
+      pos += piece.size();
+    }
+    if (p.status_ == status::eof) {
+      p.reject_utf8(p.utf8_.finish());
+    }
+  }
+  bool malformed() const noexcept {
+    assert(valid_());
+    return borrowed_ ? malformed_ : p_().status_ == status::malformed;
+  }
+
+  // Position just past what has been read so far
+  size_t buffered_end() const noexcept { return end_(); }
+
   bool seek(size_t pos) noexcept {
     force_resize_(pos);
-    if (pos > buf_().size()) {
-      current_ = buf_().size();
+    if (pos > end_()) {
+      current_ = end_();
       return false;
     }
     current_ = pos;
@@ -108,7 +358,7 @@ struct char_stream {
   bool seek(F&& func) {
     auto pos = find(std::forward<F>(func));
     if (pos == std::string::npos) {
-      current_ = buf_().size();
+      current_ = end_();
       return false;
     }
     current_ = pos;
@@ -122,18 +372,17 @@ struct char_stream {
   }
 
   char peek() const noexcept {
-    assert(handle_ != nullptr);
+    assert(valid_());
     assert(can_peek_());
 
-    if (current_ == buf_().size()) {
+    if (current_ == end_() && !stream_ended_()) {
       handle_.resume();
     }
-    return buf_()
-        .c_str()[current_]; // technically [] doesn't guarantee 0 termination
+    return at_(current_);
   }
 
   char read_char() noexcept {
-    assert(handle_ != nullptr);
+    assert(valid_());
     assert(can_peek_());
 
     char c = peek();
@@ -143,21 +392,25 @@ struct char_stream {
 
   template<std::invocable<char> F>
   size_t find(F&& func, size_t beg) const noexcept {
-    assert(handle_ != nullptr);
+    assert(valid_());
+    assert(beg >= front_());
 
     auto pos = beg;
-    while (pos < buf_().size() || !handle_.done()) {
-      if (pos >= buf_().size()) {
+    while (pos < end_() || !stream_ended_()) {
+      if (pos >= end_()) {
         handle_.resume();
       }
-      if (pos >= buf_().size()) {
+      if (pos >= end_()) {
         continue;
       }
 
-      if (func(buf_()[pos])) {
-        return pos;
+      // a chunk at a time
+      for (char c : piece_(pos)) {
+        if (func(c)) {
+          return pos;
+        }
+        pos++;
       }
-      pos++;
     }
     return std::string::npos;
 
@@ -168,64 +421,114 @@ struct char_stream {
   }
 
   size_t find(char chr) const noexcept {
-    assert(handle_ != nullptr);
+    assert(valid_());
 
-    auto pos = buf_().find(chr, current_);
-    while (pos == std::string::npos) {
-      pos = buf_().size();
-      if (!handle_.done()) {
-        handle_.resume();
-        pos = buf_().find(chr, pos);
-      } else {
-        return std::string::npos;
-      }
-    }
-    return pos;
+    return search_(current_, [&](std::string_view piece) {
+      return piece.find(chr);
+    });
   }
 
   template <class T>
     requires detail::Searchable<T>
   size_t find(T &&chr) const noexcept {
-    assert(handle_ != nullptr);
-
-    auto pos = buf_().find(chr, current_);
-    auto searched_size = std::size(chr);
-
-    while (pos == std::string::npos) {
-      pos = buf_().size();
-      if (!handle_.done()) {
-        handle_.resume();
-        auto start = searched_size > pos ? 0 : pos - searched_size;
-        pos = buf_().find(chr, start);
-      } else {
+    assert(valid_());
+
+    std::string_view pattern{chr};
+    auto pos = current_;
+    for (;;) {
+      if (auto found = find_buffered_(pattern, pos);
+          found != std::string::npos) {
+        return found;
+      }
+      // the pattern may still start in the last few chars
+      if (end_() >= pattern.size()) {
+        pos = std::max(pos, end_() - pattern.size() + 1);
+      }
+      if (stream_ended_()) {
         return std::string::npos;
       }
+      handle_.resume();
     }
-    return pos;
+  }
+
+  // First position from `from` on of any of Cs, reading as needed
+  template <char... Cs> size_t find_any(size_t from) const noexcept {
+    assert(valid_());
+    return search_(from, [](std::string_view piece) {
+      auto found = simd::find_any<Cs...>(piece.data(), piece.size());
+      return found == piece.size() ? std::string::npos : found;
+    });
   }
 
   std::string_view peek(size_t n) noexcept {
-    assert(handle_ != nullptr);
+    assert(valid_());
     assert(can_peek_());
-    return std::string_view{begin_(), n};
+    return substring_(current_, current_ + n);
   }
 
   template <typename T>
     requires detail::MultiSearchable<T>
   size_t find_first_of(T &&s) noexcept {
-    assert(handle_ != nullptr);
-    auto pos = buf_().find_first_of(s, current_);
-    while (pos == std::string::npos) {
-      pos = buf_().size();
-      if (!handle_.done()) {
-        handle_.resume();
-        pos = buf_().find_first_of(s, pos);
-      } else {
-        return std::string::npos;
-      }
+    assert(valid_());
+    return search_(current_, [&](std::string_view piece) {
+      return piece.find_first_of(s);
+    });
+  }
+
+  // Resumes the producer once, to take in whatever it has ready
+  void pull() noexcept {
+    assert(valid_());
+    if (!stream_ended_()) {
+      handle_.resume();
+    }
+  }
+
+  // Calls f(piece) with each contiguous part of what has already been read
+  // from `first` on, without copying or reading more
+  template <class F> void for_each_buffered(size_t first, F &&f) const {
+    assert(first >= front_());
+    for (auto pos = first; pos < end_();) {
+      auto piece = piece_(pos);
+      f(piece);
+      pos += piece.size();
     }
+  }
+
+  // Position of a view obtained from the stream, such as the contents of a
+  // parser event, for as long as that view is valid
+  size_t offset_of(std::string_view view) const noexcept {
+    if (borrowed_) {
+      return static_cast<size_t>(view.data() - text_.data());
+    }
+    return buf_().position_of(view.data());
+  }
+
+  // Frees what lies before the cursor, but for the last few chars that the
+  // parsers may still look back at, like the putback area of a streambuf.
+  // Memory is given back a whole chunk at a time. Positions are left as
+  // they are, but views into what is freed are invalidated.
+  void discard_consumed() noexcept {
+    assert(valid_());
+    if (borrowed_) {
+      return;
+    }
+    auto kept = std::min(current_ - front_(), kept_behind);
+    buf_().discard_before(current_ - kept);
+  }
 
-    return pos;
+  // Position of the first char still buffered
+  size_t discarded() const noexcept { return front_(); }
+
+  // Keeps what is buffered from `first` on alive for as long as `owners`
+  // holds it, so that views into it outlive discard_consumed and the
+  // stream itself. A borrowed text has nothing to share, it must outlive
+  // the views anyway.
+  void share_buffered(
+      size_t first, std::vector<std::shared_ptr<const char[]>> &owners) const {
+    assert(first >= front_());
+    if (!borrowed_) {
+      buf_().share_from(first, owners);
+    }
   }
 
   std::string_view substring(size_t first, size_t n) {
@@ -236,43 +539,34 @@ struct char_stream {
   template <typename T>
     requires detail::MultiSearchable<T>
   size_t find_first_not_of(T &&s) noexcept {
-    assert(handle_ != nullptr);
-    auto pos = buf_().find_first_not_of(s);
-    while (pos == std::string::npos) {
-      pos = buf_().size();
-      if (!handle_.done()) {
-        handle_.resume();
-        pos = buf_().find_first_not_of(s, pos);
-      } else {
-        return std::string::npos;
-      }
-    }
-
-    return pos;
+    assert(valid_());
+    return search_(current_, [&](std::string_view piece) {
+      return piece.find_first_not_of(s);
+    });
   }
 
   std::string_view consume(size_t n) noexcept {
-    assert(handle_ != nullptr);
+    assert(valid_());
     auto last = current_;
     current_ = force_resize_(current_ + n);
     return substring_(last, current_);
   }
 
   std::string_view consume_to(size_t pos) noexcept {
-    assert(handle_ != nullptr);
+    assert(valid_());
     auto last = current_;
     current_ = force_resize_(pos);
     return substring_(last, current_);
   }
 
   std::string_view readline() noexcept {
-    assert(handle_ != nullptr);
+    assert(valid_());
     auto start = current_;
     current_ = find('\n');
     if (current_ != std::string::npos) {
       current_++;
     } else {
-      current_ = buf_().size();
+      current_ = end_();
     }
     return substring_(start, current_);
   }
@@ -289,54 +583,132 @@ struct char_stream {
   }
 
   operator bool() const noexcept {
-    assert(handle_ != nullptr);
+    assert(valid_());
     return !at_eos();
   }
 
   bool at_eos() const noexcept {
-    assert(handle_ != nullptr);
-    if (current_ < buf_().size()) {
+    assert(valid_());
+    if (current_ < end_()) {
       return false;
     }
-    if (handle_.done()) {
+    if (stream_ended_()) {
       return true;
     }
     handle_.resume();
-    return current_ == buf_().size();
+    return current_ == end_();
   }
 
 private:
   bool stream_ended_() const noexcept {
-    assert(handle_ != nullptr);
-    return handle_.done() || handle_.promise().status_ != status::reading;
+    assert(valid_());
+    return borrowed_ || handle_.done() ||
+           handle_.promise().status_ != status::reading;
   }
 
+  bool valid_() const noexcept { return borrowed_ || handle_ != nullptr; }
+
   promise_type &p_() const noexcept { return handle_.promise(); }
-  std::string &buf_() const noexcept { return p_().buffer_; }
+  chunk_buffer &buf_() const noexcept { return p_().buffer_; }
+
+  // What is buffered, or all of a borrowed text
+  size_t front_() const noexcept { return borrowed_ ? 0 : buf_().begin(); }
+  size_t end_() const noexcept {
+    return borrowed_ ? text_.size() : buf_().end();
+  }
+  char at_(size_t pos) const noexcept {
+    if (borrowed_) {
+      return pos < text_.size() ? text_[pos] : '\0';
+    }
+    return buf_().at(pos);
+  }
+  std::string_view piece_(size_t pos) const noexcept {
+    return borrowed_ ? text_.substr(pos) : buf_().piece(pos);
+  }
+
+  constexpr static size_t kept_behind = 16;
 
   handle_type handle_;
   size_t current_;
+  std::string_view text_{};
+  bool borrowed_{false};
+  // a borrowed text was cut short by check_utf8
+  bool malformed_{false};
+  // a borrowed text after decode_input, when it had to be converted
+  std::unique_ptr<std::string> decoded_;
 
   inline bool can_peek_() const noexcept {
-    return (current_ < buf_().size() || !handle_.done());
-  }
-  inline const char *begin_() const noexcept {
-    return buf_().data() + current_;
+    return (current_ < end_() || !stream_ended_());
   }
 
   inline std::string_view substring_(size_t start, size_t stop) const noexcept {
-    if (stop > buf_().size()) {
-      stop = buf_().size();
+    if (stop > end_()) {
+      stop = end_();
+    }
+    if (start > stop) {
+      start = stop;
     }
-    return std::string_view{buf_().data() + start, stop - start};
+    if (borrowed_) {
+      return text_.substr(start, stop - start);
+    }
+    return buf_().view(start, stop);
   }
 
   inline size_t force_resize_(size_t pos) const noexcept {
-    while (pos >= buf_().size() && !handle_.done()) {
+    while (pos >= end_() && !stream_ended_()) {
+      handle_.resume();
+    }
+    return pos < end_() ? pos : end_();
+  }
+
+  // First position from `pos` on where find_in(piece) finds something,
+  // reading more as needed
+  template <class F>
+  size_t search_(size_t pos, F &&find_in) const noexcept {
+    for (;;) {
+      while (pos < end_()) {
+        auto piece = piece_(pos);
+        if (auto found = find_in(piece); found != std::string::npos) {
+          return pos + found;
+        }
+        pos += piece.size();
+      }
+      if (stream_ended_()) {
+        return std::string::npos;
+      }
       handle_.resume();
     }
-    return pos < buf_().size() ? pos : buf_().size();
+  }
+
+  // First occurrence of `pattern` starting from `pos` in what is buffered,
+  // including across chunks
+  size_t find_buffered_(std::string_view pattern, size_t pos) const noexcept {
+    while (pos + pattern.size() <= end_()) {
+      auto piece = piece_(pos);
+      if (auto found = simd::find_seq(piece.data(), piece.size(),
+                                      pattern.data(), pattern.size());
+          found != piece.size()) {
+        return pos + found;
+      }
+      auto piece_end = pos + piece.size();
+      auto start = piece.size() >= pattern.size()
+                       ? piece_end - pattern.size() + 1
+                       : pos;
+      for (; start < piece_end && start + pattern.size() <= end_(); ++start) {
+        std::size_t i = 0;
+        while (i < pattern.size() && at_(start + i) == pattern[i]) {
+          i++;
+        }
+        if (i == pattern.size()) {
+          return start;
+        }
+      }
+      pos = piece_end;
+    }
+    return std::string::npos;
   }
 };
 
 char_stream slurp_file(const char *filename);
+// Stream over a copy of `data`
+char_stream read_string(std::string_view data);
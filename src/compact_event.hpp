@@ -0,0 +1,187 @@
+#pragma once
+
+#include "xml.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+
+// Fixed size encoding of parser events, for consumers that store or pass
+// around many of them.
+//
+// Instead of views, a compact_event holds 32 bit offsets from the start of a
+// window of the input, so it stays meaningful when the buffer the event came
+// from moves or is copied elsewhere: decode it against wherever the window's
+// text now is. Tags keep their name id, but attributes and namespaces only
+// keep their text, and errors only their offset from the window start.
+namespace xml {
+enum class event_kind : std::uint8_t {
+  tag_open,
+  tag_close,
+  tag_self_close,
+  tag_attribute,
+  tag_content,
+  comment,
+  processing_instruction_begin,
+  processing_instruction_end,
+  parse_error,
+};
+
+struct compact_event {
+  // Of the name, key or text, from the start of the window
+  std::uint32_t offset;
+  std::uint32_t length;
+  // Name id of tags, value length of attributes, 1 for text from a CDATA
+  // section
+  std::uint32_t extra;
+  // From the end of an attribute key to the start of its value
+  std::uint16_t value_gap;
+  event_kind kind;
+  std::uint8_t reserved{0};
+};
+static_assert(sizeof(compact_event) == 16);
+
+namespace detail {
+template <class Event> constexpr event_kind kind_of() {
+  if constexpr (std::is_same_v<Event, tag_open>) {
+    return event_kind::tag_open;
+  } else if constexpr (std::is_same_v<Event, tag_close>) {
+    return event_kind::tag_close;
+  } else if constexpr (std::is_same_v<Event, tag_self_close>) {
+    return event_kind::tag_self_close;
+  } else if constexpr (std::is_same_v<Event, tag_attribute>) {
+    return event_kind::tag_attribute;
+  } else if constexpr (std::is_same_v<Event, tag_content>) {
+    return event_kind::tag_content;
+  } else if constexpr (std::is_same_v<Event, comment>) {
+    return event_kind::comment;
+  } else if constexpr (std::is_same_v<Event, processing_instruction_begin>) {
+    return event_kind::processing_instruction_begin;
+  } else if constexpr (std::is_same_v<Event, processing_instruction_end>) {
+    return event_kind::processing_instruction_end;
+  } else {
+    static_assert(std::is_same_v<Event, parse_error>);
+    return event_kind::parse_error;
+  }
+}
+} // namespace detail
+
+// Encodes an event that the parser on `stream` just produced, relative to
+// the window starting at stream position `window`. Like event_offset, it
+// must be called while the event is handled. nullopt if the event doesn't
+// fit, being 4 GiB or more past the window start.
+inline std::optional<compact_event>
+encode_event(const char_stream &stream, std::size_t window,
+             const auto &event) noexcept {
+  using Event = std::decay_t<decltype(event)>;
+  if constexpr (requires { event.valueless_by_exception(); }) {
+    return std::visit(
+        [&](const auto &e) { return encode_event(stream, window, e); },
+        event);
+  } else {
+    constexpr auto max = std::numeric_limits<std::uint32_t>::max();
+    auto offset = event_offset(stream, event);
+    std::size_t length = 0;
+    if constexpr (requires { event.name; }) {
+      length = event.name.size();
+    } else if constexpr (requires { event.key; }) {
+      length = event.key.size();
+    } else if constexpr (requires { event.content; }) {
+      length = event.content.size();
+    } else if constexpr (requires { event.comment; }) {
+      length = event.comment.size();
+    }
+    if (offset < window || offset - window > max || length > max) {
+      return std::nullopt;
+    }
+    compact_event result{
+        .offset = static_cast<std::uint32_t>(offset - window),
+        .length = static_cast<std::uint32_t>(length),
+        .extra = 0,
+        .value_gap = 0,
+        .kind = detail::kind_of<Event>()};
+    if constexpr (requires { event.id; event.name; }) {
+      result.extra = event.id;
+    } else if constexpr (requires { event.cdata; }) {
+      result.extra = event.cdata;
+    } else if constexpr (requires { event.value; }) {
+      // valueless attributes don't point into the stream
+      if (!event.value.empty()) {
+        auto gap = stream.offset_of(event.value) - (offset + length);
+        if (gap > std::numeric_limits<std::uint16_t>::max() ||
+            event.value.size() > max) {
+          return std::nullopt;
+        }
+        result.value_gap = static_cast<std::uint16_t>(gap);
+        result.extra = static_cast<std::uint32_t>(event.value.size());
+      }
+    }
+    return result;
+  }
+}
+
+// The event that `event` encodes, viewing into `text`, the window it was
+// encoded against. Its kind must be one the parser for Config produces.
+// nullopt if its text doesn't lie within `text`.
+template <config Config>
+std::optional<typename configurable_xml_parser<Config>::event_type>
+decode_event(const compact_event &event, std::string_view text) noexcept {
+  using event_type = typename configurable_xml_parser<Config>::event_type;
+  auto within = [&](std::size_t offset, std::size_t length) {
+    return offset <= text.size() && length <= text.size() - offset;
+  };
+  if (event.kind != event_kind::parse_error &&
+      !within(event.offset, event.length)) {
+    return std::nullopt;
+  }
+  auto view = event.kind == event_kind::parse_error
+                  ? std::string_view{}
+                  : text.substr(event.offset, event.length);
+  auto make = [&]<class Event>(Event &&e) -> event_type {
+    if constexpr (std::is_constructible_v<event_type, Event>) {
+      return std::forward<Event>(e);
+    } else {
+      assert(false && "event not produced with this config");
+      return {};
+    }
+  };
+  auto with_names = [&]<class Event>(Event e) {
+    if constexpr (Config.process_namespaces) {
+      e.local = local_name(view);
+    }
+    return e;
+  };
+  switch (event.kind) {
+  case event_kind::tag_open:
+    return make(with_names(tag_open{view, event.extra}));
+  case event_kind::tag_close:
+    return make(with_names(tag_close{view, event.extra}));
+  case event_kind::tag_self_close:
+    return make(tag_self_close{});
+  case event_kind::tag_attribute: {
+    auto value_start = std::size_t{event.offset} + event.length +
+                       event.value_gap;
+    if (!within(value_start, event.extra)) {
+      return std::nullopt;
+    }
+    return make(with_names(
+        tag_attribute{view, text.substr(value_start, event.extra)}));
+  }
+  case event_kind::tag_content:
+    return make(tag_content{view, event.extra != 0});
+  case event_kind::comment:
+    return make(comment{view});
+  case event_kind::processing_instruction_begin:
+    return make(processing_instruction_begin{view});
+  case event_kind::processing_instruction_end:
+    return make(processing_instruction_end{});
+  case event_kind::parse_error:
+    return make(parse_error{event.offset, {}});
+  }
+  return make(tag_self_close{});
+}
+} // namespace xml
@@ -0,0 +1,344 @@
+#include "convert.hpp"
+
+#include "simd.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <variant>
+
+namespace xml {
+namespace {
+constexpr auto npos = std::string_view::npos;
+
+// Only what the records are made of
+constexpr config convert_config{.emit_processing_instruction_begin = false,
+                                .emit_processing_instruction_end = false};
+
+void append_utf8(std::string &out, std::uint32_t cp) {
+  if (cp < 0x80) {
+    out += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    out += static_cast<char>(0xC0 | (cp >> 6));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    out += static_cast<char>(0xE0 | (cp >> 12));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (cp >> 18));
+    out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  }
+}
+
+// Appends `text` with the predefined entities and character references
+// expanded. Anything else is kept as is.
+void append_expanded(std::string &out, std::string_view text) {
+  for (;;) {
+    auto amp = simd::find_any<'&'>(text.data(), text.size());
+    out.append(text.substr(0, amp));
+    if (amp == text.size()) {
+      return;
+    }
+    text.remove_prefix(amp);
+    auto semicolon = text.find(';');
+    auto name = text.substr(1, semicolon == npos ? 0 : semicolon - 1);
+    std::uint32_t cp = 0;
+    if (name == "lt") {
+      out += '<';
+    } else if (name == "gt") {
+      out += '>';
+    } else if (name == "amp") {
+      out += '&';
+    } else if (name == "quot") {
+      out += '"';
+    } else if (name == "apos") {
+      out += '\'';
+    } else if (name.size() > 1 && name[0] == '#') {
+      bool hex = name[1] == 'x';
+      auto digits = name.substr(hex ? 2 : 1);
+      auto [end, ec] = std::from_chars(
+          digits.data(), digits.data() + digits.size(), cp, hex ? 16 : 10);
+      // surrogates aren't characters, and have no UTF-8 of their own
+      if (ec != std::errc{} || end != digits.data() + digits.size() ||
+          cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        semicolon = npos;
+      } else {
+        append_utf8(out, cp);
+      }
+    } else {
+      semicolon = npos;
+    }
+    if (semicolon == npos) {
+      out += '&';
+      text.remove_prefix(1);
+    } else {
+      text.remove_prefix(semicolon + 1);
+    }
+  }
+}
+
+std::string_view trimmed(std::string_view text) {
+  auto first = find_non_space(text);
+  if (first == text.size()) {
+    return text.substr(first);
+  }
+  auto last = text.find_last_not_of(" \t\n\v\f\r");
+  return text.substr(first, last + 1 - first);
+}
+
+void write_json_string(buffered_writer &out, std::string_view text) {
+  constexpr char hex[] = "0123456789abcdef";
+  out.put('"');
+  while (!text.empty()) {
+    auto special = std::find_if(text.begin(), text.end(), [](char c) {
+      return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+    });
+    auto pos = static_cast<std::size_t>(special - text.begin());
+    out.write(text.substr(0, pos));
+    if (pos == text.size()) {
+      break;
+    }
+    auto c = static_cast<unsigned char>(text[pos]);
+    out.put('\\');
+    switch (c) {
+    case '"':
+    case '\\':
+      out.put(static_cast<char>(c));
+      break;
+    case '\n':
+      out.put('n');
+      break;
+    case '\t':
+      out.put('t');
+      break;
+    case '\r':
+      out.put('r');
+      break;
+    default:
+      out.write("u00");
+      out.put(hex[c >> 4]);
+      out.put(hex[c & 0xF]);
+    }
+    text.remove_prefix(pos + 1);
+  }
+  out.put('"');
+}
+
+void write_csv_field(buffered_writer &out, std::string_view text) {
+  if (simd::find_any<',', '"', '\n', '\r'>(text.data(), text.size()) ==
+      text.size()) {
+    out.write(text);
+    return;
+  }
+  out.put('"');
+  for (;;) {
+    auto quote = text.find('"');
+    out.write(text.substr(0, quote));
+    if (quote == npos) {
+      break;
+    }
+    out.write("\"\"");
+    text.remove_prefix(quote + 1);
+  }
+  out.put('"');
+}
+
+class converter {
+public:
+  converter(const record_mapping &mapping, output_format format,
+            buffered_writer &out, char_stream &stream)
+      : mapping_{mapping}, format_{format}, out_{out}, stream_{stream} {
+    for (auto &field : mapping.fields) {
+      fields_.push_back(compile_(field.path));
+    }
+  }
+
+  std::size_t records() const noexcept { return records_; }
+
+  void header() {
+    for (std::size_t i = 0; i < mapping_.fields.size(); ++i) {
+      if (i != 0) {
+        out_.put(',');
+      }
+      write_csv_field(out_, mapping_.fields[i].column);
+    }
+    out_.put('\n');
+  }
+
+  void operator()(const tag_open &ev) {
+    if (!in_record_) {
+      if (ev.name != mapping_.record) {
+        return;
+      }
+      in_record_ = true;
+      depth_ = 0;
+      for (auto &f : fields_) {
+        f.state = field_state::missing;
+        f.value.clear();
+      }
+    } else {
+      if (depth_ == path_.size()) {
+        path_.emplace_back(ev.name);
+      } else {
+        path_[depth_].assign(ev.name);
+      }
+      depth_++;
+    }
+    for (auto &f : fields_) {
+      if (!f.is_attribute && f.state == field_state::missing &&
+          matches_(f)) {
+        f.state = field_state::reading;
+      }
+    }
+  }
+
+  void operator()(const tag_attribute &ev) {
+    if (!in_record_) {
+      return;
+    }
+    for (auto &f : fields_) {
+      if (f.is_attribute && f.state == field_state::missing &&
+          f.attribute == ev.key && matches_(f)) {
+        append_expanded(f.value, ev.value);
+        f.state = field_state::done;
+      }
+    }
+  }
+
+  void operator()(const tag_content &ev) {
+    if (!in_record_) {
+      return;
+    }
+    for (auto &f : fields_) {
+      if (f.state == field_state::reading && f.steps.size() == depth_) {
+        append_expanded(f.value, ev.content);
+      }
+    }
+  }
+
+  void operator()(const tag_close &) { close_(); }
+  void operator()(const tag_self_close &) { close_(); }
+
+  template <class Event> void operator()(const Event &) {}
+
+private:
+  enum class field_state : std::uint8_t { missing, reading, done };
+
+  struct compiled_field {
+    // elements below the record
+    std::vector<std::string> steps;
+    std::string attribute;
+    bool is_attribute{false};
+    field_state state{field_state::missing};
+    std::string value;
+  };
+
+  static compiled_field compile_(std::string_view path) {
+    compiled_field field;
+    while (!path.empty()) {
+      auto slash = path.find('/');
+      auto step = path.substr(0, slash);
+      if (step.starts_with('@')) {
+        field.attribute = step.substr(1);
+        field.is_attribute = true;
+        break;
+      }
+      if (!step.empty() && step != ".") {
+        field.steps.emplace_back(step);
+      }
+      path.remove_prefix(slash == npos ? path.size() : slash + 1);
+    }
+    return field;
+  }
+
+  bool matches_(const compiled_field &f) const {
+    return f.steps.size() == depth_ &&
+           std::equal(f.steps.begin(), f.steps.end(), path_.begin());
+  }
+
+  void close_() {
+    if (!in_record_) {
+      return;
+    }
+    for (auto &f : fields_) {
+      if (f.state == field_state::reading && f.steps.size() == depth_) {
+        f.state = field_state::done;
+      }
+    }
+    if (depth_ > 0) {
+      depth_--;
+      return;
+    }
+    in_record_ = false;
+    records_++;
+    row_();
+    // the parser holds no position before the end of a record
+    stream_.discard_consumed();
+  }
+
+  void row_() {
+    if (format_ == output_format::json_lines) {
+      out_.put('{');
+      for (std::size_t i = 0; i < fields_.size(); ++i) {
+        if (i != 0) {
+          out_.put(',');
+        }
+        write_json_string(out_, mapping_.fields[i].column);
+        out_.put(':');
+        if (fields_[i].state == field_state::missing) {
+          out_.write("null");
+        } else {
+          write_json_string(out_, trimmed(fields_[i].value));
+        }
+      }
+      out_.write("}\n");
+    } else {
+      for (std::size_t i = 0; i < fields_.size(); ++i) {
+        if (i != 0) {
+          out_.put(',');
+        }
+        write_csv_field(out_, trimmed(fields_[i].value));
+      }
+      out_.put('\n');
+    }
+  }
+
+  const record_mapping &mapping_;
+  output_format format_;
+  buffered_writer &out_;
+  char_stream &stream_;
+  std::vector<compiled_field> fields_;
+  // names of the elements open below the record, reused across records
+  std::vector<std::string> path_;
+  std::size_t depth_{0};
+  bool in_record_{false};
+  std::size_t records_{0};
+};
+} // namespace
+
+field_mapping parse_field(std::string_view text) {
+  auto equal = text.find('=');
+  if (equal == npos) {
+    return {std::string{text}, std::string{text}};
+  }
+  return {std::string{text.substr(0, equal)},
+          std::string{text.substr(equal + 1)}};
+}
+
+std::size_t convert_records(char_stream &stream, const record_mapping &mapping,
+                            output_format format, buffered_writer &out,
+                            context &ctx) {
+  converter convert{mapping, format, out, stream};
+  if (format == output_format::csv) {
+    convert.header();
+  }
+  auto parser = parse_xml<convert_config>(stream, ctx);
+  while (parser) {
+    std::visit(convert, parser.event());
+  }
+  return convert.records();
+}
+} // namespace xml
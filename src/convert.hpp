@@ -0,0 +1,42 @@
+#pragma once
+
+#include "buffered_writer.hpp"
+#include "xml.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Flattening records of a document into JSON lines or CSV rows
+namespace xml {
+// One output column, taken from a path relative to the record element:
+// "@id" is an attribute of the record, "name" the text of a child,
+// "item/@sku" an attribute of a child, "a/b" the text of a grandchild and
+// "." the record's own text. The first match in a record wins.
+struct field_mapping {
+  std::string column;
+  std::string path;
+};
+
+struct record_mapping {
+  // Name of the record elements, at any depth but not nested in each other
+  std::string record;
+  std::vector<field_mapping> fields;
+};
+
+// Reads "column=path", or just "path" which then also names the column
+field_mapping parse_field(std::string_view text);
+
+enum class output_format { json_lines, csv };
+
+// Writes one row per record of `stream` to `out`: a JSON object per line
+// with null for missing fields, or CSV after a header row. Text is trimmed,
+// and references are expanded in text and attribute values. Input is
+// discarded as records are done, so memory use depends on the largest
+// record rather than on the document. Returns the number of records, and
+// stops at the first parse error, which is left in ctx.error.
+std::size_t convert_records(char_stream &stream, const record_mapping &mapping,
+                            output_format format, buffered_writer &out,
+                            context &ctx);
+} // namespace xml
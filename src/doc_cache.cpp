@@ -0,0 +1,226 @@
+#include "doc_cache.hpp"
+
+#include "hash.hpp"
+#include "snapshot.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <optional>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace xml {
+namespace {
+std::size_t approximate_size(const tag &xml) {
+  std::size_t total = sizeof(tag) + xml.name.capacity() +
+                      xml.content.capacity() +
+                      xml.attributes.capacity() * sizeof(attribute);
+  for (auto &attr : xml.attributes) {
+    total += attr.name.capacity() + attr.value.capacity();
+  }
+  total += (xml.children.capacity() - xml.children.size()) * sizeof(tag);
+  for (auto &child : xml.children) {
+    total += approximate_size(child) - sizeof(tag);
+  }
+  return total;
+}
+
+std::optional<std::string> read_file(int fd, std::size_t size) {
+  std::string content(size, '\0');
+  std::size_t done = 0;
+  while (done < size) {
+    auto n = ::read(fd, content.data() + done, size - done);
+    if (n < 0) {
+      return std::nullopt;
+    }
+    if (n == 0) {
+      content.resize(done);
+      break;
+    }
+    done += static_cast<std::size_t>(n);
+  }
+  return content;
+}
+} // namespace
+
+doc_cache::doc_cache(std::size_t max_bytes, std::string disk_directory)
+    : max_bytes_{max_bytes}, disk_directory_{std::move(disk_directory)} {}
+
+doc_cache::document doc_cache::load(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  DEFER { ::close(fd); };
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    return nullptr;
+  }
+  file_key key{
+      .size = static_cast<std::uint64_t>(st.st_size),
+      .mtime = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 +
+               st.st_mtim.tv_nsec,
+      .content = {},
+  };
+
+  {
+    std::lock_guard lock{mutex_};
+    if (auto it = files_.find(path); it != files_.end() &&
+                                     it->second.size == key.size &&
+                                     it->second.mtime == key.mtime) {
+      if (auto doc = lookup_(it->second.content)) {
+        return doc;
+      }
+    }
+  }
+
+  auto content = read_file(fd, key.size);
+  if (!content) {
+    return nullptr;
+  }
+  key.content = {
+      .hash = fast_hash(content->data(), content->size()),
+      .size = content->size(),
+  };
+
+  {
+    std::lock_guard lock{mutex_};
+    if (auto doc = lookup_(key.content)) {
+      insert_(path, key, doc);
+      return doc;
+    }
+  }
+
+  document doc = load_snapshot_(key.content);
+  bool from_disk = doc != nullptr;
+  if (!from_disk) {
+    char_stream stream{*content};
+    auto parsed = build_xml_doc(stream);
+    if (!parsed) {
+      std::lock_guard lock{mutex_};
+      stats_.misses++;
+      return nullptr;
+    }
+    doc = std::make_shared<const tag>(std::move(parsed).value());
+    save_snapshot_(key.content, *doc);
+  }
+
+  std::lock_guard lock{mutex_};
+  if (from_disk) {
+    stats_.disk_hits++;
+  } else {
+    stats_.misses++;
+  }
+  insert_(path, key, doc);
+  return doc;
+}
+
+doc_cache_stats doc_cache::stats() const {
+  std::lock_guard lock{mutex_};
+  return stats_;
+}
+
+void doc_cache::clear() {
+  std::lock_guard lock{mutex_};
+  lru_.clear();
+  documents_.clear();
+  files_.clear();
+  stats_.bytes = 0;
+  stats_.documents = 0;
+}
+
+doc_cache::document doc_cache::lookup_(content_key content) {
+  auto it = documents_.find(content);
+  if (it == documents_.end()) {
+    return nullptr;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.lru);
+  stats_.hits++;
+  return it->second.doc;
+}
+
+void doc_cache::insert_(const std::string &path, file_key key,
+                        document doc) {
+  if (auto it = documents_.find(key.content); it != documents_.end()) {
+    // known content under a new path or mtime, or parsed concurrently
+    files_.insert_or_assign(path, key);
+    auto &paths = it->second.paths;
+    if (std::find(paths.begin(), paths.end(), path) == paths.end()) {
+      paths.push_back(path);
+    }
+    return;
+  }
+  auto bytes = approximate_size(*doc);
+  if (bytes > max_bytes_) {
+    return;
+  }
+  files_.insert_or_assign(path, key);
+  lru_.push_front(key.content);
+  documents_.emplace(key.content, entry{
+                                   .doc = std::move(doc),
+                                   .bytes = bytes,
+                                   .lru = lru_.begin(),
+                                   .paths = {path},
+                               });
+  stats_.bytes += bytes;
+  stats_.documents++;
+  evict_();
+}
+
+void doc_cache::evict_() {
+  while (stats_.bytes > max_bytes_ && !lru_.empty()) {
+    auto it = documents_.find(lru_.back());
+    for (auto &path : it->second.paths) {
+      if (auto file = files_.find(path);
+          file != files_.end() && file->second.content == it->first) {
+        files_.erase(file);
+      }
+    }
+    stats_.bytes -= it->second.bytes;
+    stats_.documents--;
+    stats_.evictions++;
+    documents_.erase(it);
+    lru_.pop_back();
+  }
+}
+
+doc_cache::document doc_cache::load_snapshot_(content_key content) const {
+  if (disk_directory_.empty()) {
+    return nullptr;
+  }
+  auto snap = snapshot::open(snapshot_path_(content).c_str());
+  if (!snap) {
+    return nullptr;
+  }
+  return std::make_shared<const tag>(snap->root().to_tag());
+}
+
+void doc_cache::save_snapshot_(content_key content,
+                               const tag &doc) const {
+  if (disk_directory_.empty()) {
+    return;
+  }
+  // written aside then renamed, so readers never see a partial file
+  auto path = snapshot_path_(content);
+  static std::atomic<unsigned> counter{0};
+  auto tmp = path + ".tmp." + std::to_string(::getpid()) + '.' +
+             std::to_string(counter++);
+  if (save_snapshot(doc, tmp.c_str())) {
+    std::rename(tmp.c_str(), path.c_str());
+  } else {
+    std::remove(tmp.c_str());
+  }
+}
+
+std::string doc_cache::snapshot_path_(content_key content) const {
+  char name[64];
+  std::snprintf(name, sizeof(name), "/%016llx-%llx.xsnap",
+                static_cast<unsigned long long>(content.hash),
+                static_cast<unsigned long long>(content.size));
+  return disk_directory_ + name;
+}
+} // namespace xml
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "string_map.hpp"
+#include "xml.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace xml {
+struct doc_cache_stats {
+  std::uint64_t hits{0};
+  std::uint64_t disk_hits{0};
+  std::uint64_t misses{0};
+  std::uint64_t evictions{0};
+  std::size_t bytes{0};
+  std::size_t documents{0};
+};
+
+// Opt-in cache in front of build_xml_doc for files that are loaded again and
+// again. A file whose path, size and mtime are unchanged is served without
+// being read; otherwise it is read and hashed, and only parsed if no document
+// with the same content hash and size is known. Documents are shared and
+// immutable, and the least recently used ones are dropped once `max_bytes` is
+// exceeded.
+// With a `disk_directory`, parsed documents are also kept there as snapshots
+// and reloaded from it after they've been evicted or on a later run.
+class doc_cache {
+public:
+  using document = std::shared_ptr<const tag>;
+
+  explicit doc_cache(std::size_t max_bytes, std::string disk_directory = {});
+
+  // nullptr if the file can't be read or parsed
+  document load(const std::string &path);
+
+  doc_cache_stats stats() const;
+  void clear();
+
+private:
+  // The size goes with the hash so that two contents only share a document
+  // if they also have the same length
+  struct content_key {
+    std::uint64_t hash;
+    std::uint64_t size;
+    bool operator==(const content_key &) const = default;
+  };
+  struct content_key_hash {
+    std::size_t operator()(const content_key &key) const noexcept {
+      return static_cast<std::size_t>(key.hash ^ key.size);
+    }
+  };
+  struct file_key {
+    std::uint64_t size;
+    std::int64_t mtime;
+    content_key content;
+  };
+  struct entry {
+    document doc;
+    std::size_t bytes;
+    std::list<content_key>::iterator lru;
+    std::vector<std::string> paths;
+  };
+
+  document lookup_(content_key content);
+  void insert_(const std::string &path, file_key key, document doc);
+  void evict_();
+  document load_snapshot_(content_key content) const;
+  void save_snapshot_(content_key content, const tag &doc) const;
+  std::string snapshot_path_(content_key content) const;
+
+  std::size_t max_bytes_;
+  std::string disk_directory_;
+
+  mutable std::mutex mutex_;
+  // contents, most recently used first
+  std::list<content_key> lru_;
+  std::unordered_map<content_key, entry, content_key_hash> documents_;
+  string_map<std::string, file_key> files_;
+  doc_cache_stats stats_;
+};
+} // namespace xml
@@ -0,0 +1,58 @@
+#include "dom_index.hpp"
+
+namespace xml {
+namespace {
+const dom_index::nodes no_nodes;
+}
+
+dom_index::dom_index(const tag &root, bool lazy) : root_{&root} {
+  if (!lazy) {
+    std::call_once(built_, &dom_index::build_, this);
+  }
+}
+
+const dom_index::nodes &dom_index::elements(std::string_view name) const {
+  std::call_once(built_, &dom_index::build_, this);
+  auto it = elements_.find(name);
+  return it == elements_.end() ? no_nodes : it->second;
+}
+
+const dom_index::nodes &dom_index::find(std::string_view attribute,
+                                        std::string_view value) const {
+  std::call_once(built_, &dom_index::build_, this);
+  auto by_name = attributes_.find(attribute);
+  if (by_name == attributes_.end()) {
+    return no_nodes;
+  }
+  auto it = by_name->second.find(value);
+  return it == by_name->second.end() ? no_nodes : it->second;
+}
+
+const tag *dom_index::find_first(std::string_view attribute,
+                                 std::string_view value) const {
+  auto &found = find(attribute, value);
+  return found.empty() ? nullptr : found.front();
+}
+
+void dom_index::build_() const {
+  // explicit stack rather than recursion, pushed in reverse to keep
+  // document order
+  std::vector<const tag *> pending{root_};
+  while (!pending.empty()) {
+    const tag *current = pending.back();
+    pending.pop_back();
+
+    // the root returned by build_xml_doc has no name
+    if (!current->name.empty()) {
+      elements_[current->name].push_back(current);
+    }
+    for (auto &attr : current->attributes) {
+      attributes_[attr.name][attr.value].push_back(current);
+    }
+    for (auto it = current->children.rbegin(); it != current->children.rend();
+         ++it) {
+      pending.push_back(&*it);
+    }
+  }
+}
+} // namespace xml
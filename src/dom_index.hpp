@@ -0,0 +1,41 @@
+#pragma once
+
+#include "string_map.hpp"
+#include "xml.hpp"
+
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace xml {
+// Lookup tables over a parsed document: elements by name, and elements by
+// attribute name and value. Both lists are in document order. The index
+// points into the tree, which must outlive it and stay unmodified.
+//
+// It is built in a single walk, either up front or on the first query, so
+// that every query after that is a hash lookup. Queries may run concurrently.
+class dom_index {
+public:
+  using nodes = std::vector<const tag *>;
+
+  explicit dom_index(const tag &root, bool lazy = false);
+
+  dom_index(const dom_index &) = delete;
+  dom_index &operator=(const dom_index &) = delete;
+
+  const nodes &elements(std::string_view name) const;
+  const nodes &find(std::string_view attribute, std::string_view value) const;
+  // First element in document order whose `attribute` equals `value`
+  const tag *find_first(std::string_view attribute,
+                        std::string_view value) const;
+
+private:
+  void build_() const;
+
+  const tag *root_;
+  mutable std::once_flag built_;
+  mutable string_map<std::string_view, nodes> elements_;
+  mutable string_map<std::string_view, string_map<std::string_view, nodes>>
+      attributes_;
+};
+} // namespace xml
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace xml {
+// Names of the elements being parsed, outermost first, so that end tags can
+// be matched against them. The strings are kept from one element to the
+// next, so once the stack has been as deep as the document a push doesn't
+// allocate.
+class element_stack {
+public:
+  void push(std::string_view name) {
+    if (size_ == names_.size()) {
+      names_.emplace_back(name);
+    } else {
+      names_[size_].assign(name);
+    }
+    size_++;
+  }
+  void pop() noexcept { size_--; }
+  // Drops the elements past `depth`
+  void close_to(std::size_t depth) noexcept { size_ = std::min(size_, depth); }
+
+  std::size_t size() const noexcept { return size_; }
+  // Valid until the next push
+  std::string_view innermost() const noexcept { return names_[size_ - 1]; }
+
+  // Depth of the innermost open element named `name`, from 1 for the
+  // outermost, or 0 if none is
+  std::size_t find(std::string_view name) const noexcept {
+    for (auto depth = size_; depth > 0; --depth) {
+      if (names_[depth - 1] == name) {
+        return depth;
+      }
+    }
+    return 0;
+  }
+
+  // Set to the depth of the element an end tag closed while the ones inside
+  // it are closed too, and back to 0 once that element is
+  void unwind_to(std::size_t depth) noexcept { unwinding_ = depth; }
+  std::size_t unwinding() const noexcept { return unwinding_; }
+
+  void reset() noexcept {
+    size_ = 0;
+    unwinding_ = 0;
+  }
+
+private:
+  std::vector<std::string> names_;
+  std::size_t size_{0};
+  std::size_t unwinding_{0};
+};
+} // namespace xml
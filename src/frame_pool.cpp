@@ -0,0 +1,33 @@
+#include "frame_pool.hpp"
+
+frame_pool::~frame_pool() noexcept {
+  for (auto head : free_) {
+    while (head != nullptr) {
+      ::operator delete(std::exchange(head, head->next));
+    }
+  }
+}
+
+void *frame_pool::local_allocate(std::size_t size) {
+  auto pool = local_();
+  return pool != nullptr ? pool->allocate(size) : ::operator new(size);
+}
+
+void frame_pool::local_deallocate(void *frame, std::size_t size) noexcept {
+  if (auto pool = local_()) {
+    pool->deallocate(frame, size);
+  } else {
+    ::operator delete(frame);
+  }
+}
+
+frame_pool *frame_pool::local_() noexcept {
+  // trivially destructible, so that it can still be read while the
+  // thread's other objects are destroyed, frames owned by them included
+  thread_local bool gone = false;
+  thread_local struct owner {
+    frame_pool pool;
+    ~owner() { gone = true; }
+  } local;
+  return gone ? nullptr : &local.pool;
+}
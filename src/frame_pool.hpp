@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// Recycles coroutine frames. A parse creates and destroys a frame for every
+// nested construct, so instead of going back to the allocator each time,
+// freed frames are kept on a free list per size class and handed out again.
+// Each thread has its own pool; a frame may be freed on another thread than
+// the one it came from, it then joins that thread's pool. Once a thread's
+// pool is destroyed at thread exit, its frames go straight to the allocator.
+class frame_pool {
+public:
+  // Frames are rounded up to a multiple of this
+  constexpr static std::size_t granularity = 64;
+  // Bigger frames aren't pooled
+  constexpr static std::size_t max_pooled = 4096;
+  // Frames kept per size class, past that they are freed
+  constexpr static std::size_t max_kept = 256;
+
+  frame_pool() = default;
+  frame_pool(const frame_pool &) = delete;
+  frame_pool &operator=(const frame_pool &) = delete;
+  ~frame_pool() noexcept;
+
+  // Through the calling thread's pool, if it is still there
+  static void *local_allocate(std::size_t size);
+  static void local_deallocate(void *frame, std::size_t size) noexcept;
+
+  void *allocate(std::size_t size) {
+    if (size > max_pooled) {
+      return ::operator new(size);
+    }
+    auto index = class_of_(size);
+    auto &head = free_[index];
+    if (head == nullptr) {
+      return ::operator new(rounded_(size));
+    }
+    kept_[index]--;
+    return std::exchange(head, head->next);
+  }
+
+  void deallocate(void *frame, std::size_t size) noexcept {
+    auto index = class_of_(size);
+    if (size > max_pooled || kept_[index] == max_kept) {
+      ::operator delete(frame);
+      return;
+    }
+    kept_[index]++;
+    free_[index] = ::new (frame) block{free_[index]};
+  }
+
+private:
+  struct block {
+    block *next;
+  };
+
+  // nullptr once the thread's pool is destroyed
+  static frame_pool *local_() noexcept;
+
+  constexpr static std::size_t class_of_(std::size_t size) noexcept {
+    return size == 0 ? 0 : (size - 1) / granularity;
+  }
+  constexpr static std::size_t rounded_(std::size_t size) noexcept {
+    return (class_of_(size) + 1) * granularity;
+  }
+
+  std::array<block *, max_pooled / granularity> free_{};
+  std::array<std::size_t, max_pooled / granularity> kept_{};
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace hash_detail {
+constexpr inline std::uint64_t prime1 = 0x9E3779B185EBCA87ull;
+constexpr inline std::uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+
+inline std::uint64_t mix(std::uint64_t h, std::uint64_t word) noexcept {
+  h ^= word * prime2;
+  h = (h << 31) | (h >> 33);
+  return h * prime1;
+}
+
+inline std::uint64_t load(const unsigned char *p) noexcept {
+  std::uint64_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+inline void start(std::uint64_t (&lanes)[4], std::uint64_t seed) noexcept {
+  lanes[0] = seed + prime1;
+  lanes[1] = seed ^ prime2;
+  lanes[2] = seed - prime1;
+  lanes[3] = ~seed;
+}
+
+// Eats the whole 32 byte rounds at p, leaving p and size at what's left
+inline void rounds(std::uint64_t (&lanes)[4], const unsigned char *&p,
+                   std::size_t &size) noexcept {
+  for (; size >= 32; size -= 32, p += 32) {
+    for (int i = 0; i < 4; ++i) {
+      lanes[i] = mix(lanes[i], load(p + 8 * i));
+    }
+  }
+}
+
+// Folds the lanes with the last `size` bytes, fewer than 32, of `total`
+inline std::uint64_t finish(const std::uint64_t (&lanes)[4],
+                            const unsigned char *p, std::size_t size,
+                            std::uint64_t total) noexcept {
+  std::uint64_t h = lanes[0] ^ ((lanes[1] << 7) | (lanes[1] >> 57)) ^
+                    ((lanes[2] << 19) | (lanes[2] >> 45)) ^
+                    ((lanes[3] << 41) | (lanes[3] >> 23));
+  for (; size >= 8; size -= 8, p += 8) {
+    h = mix(h, load(p));
+  }
+  std::uint64_t tail = size;
+  for (std::size_t i = 0; i < size; ++i) {
+    tail = (tail << 8) | p[i];
+  }
+  h = mix(mix(h, tail), total);
+
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  return h;
+}
+} // namespace hash_detail
+
+// Non-cryptographic 64 bit hash for checksums and content keys. Four
+// independent lanes eat 32 bytes per round so the multiplies overlap.
+inline std::uint64_t fast_hash(const void *data, std::size_t size,
+                               std::uint64_t seed = 0) noexcept {
+  auto p = static_cast<const unsigned char *>(data);
+  auto total = static_cast<std::uint64_t>(size);
+  std::uint64_t lanes[4];
+  hash_detail::start(lanes, seed);
+  hash_detail::rounds(lanes, p, size);
+  return hash_detail::finish(lanes, p, size, total);
+}
+
+// fast_hash of data that comes in pieces, the same as hashing them back to
+// back but without putting them together first
+class fast_hasher {
+public:
+  explicit fast_hasher(std::uint64_t seed = 0) noexcept {
+    hash_detail::start(lanes_, seed);
+  }
+
+  void update(const void *data, std::size_t size) noexcept {
+    if (size == 0) {
+      return;
+    }
+    auto p = static_cast<const unsigned char *>(data);
+    total_ += size;
+    if (pending_size_ != 0) {
+      auto n = size < 32 - pending_size_ ? size : 32 - pending_size_;
+      std::memcpy(pending_ + pending_size_, p, n);
+      pending_size_ += n;
+      p += n;
+      size -= n;
+      if (pending_size_ < 32) {
+        return;
+      }
+      const unsigned char *round = pending_;
+      std::size_t round_size = 32;
+      hash_detail::rounds(lanes_, round, round_size);
+      pending_size_ = 0;
+    }
+    hash_detail::rounds(lanes_, p, size);
+    std::memcpy(pending_, p, size);
+    pending_size_ = size;
+  }
+
+  std::uint64_t finish() const noexcept {
+    return hash_detail::finish(lanes_, pending_, pending_size_, total_);
+  }
+
+private:
+  std::uint64_t lanes_[4];
+  unsigned char pending_[32];
+  std::size_t pending_size_{0};
+  std::uint64_t total_{0};
+};
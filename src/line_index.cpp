@@ -0,0 +1,22 @@
+#include "line_index.hpp"
+
+#include "simd.hpp"
+
+#include <algorithm>
+
+void line_index::update(const char_stream &stream) {
+  stream.for_each_buffered(scanned_, [&](std::string_view text) {
+    auto base = scanned_;
+    simd::for_each<'\n'>(text.data(), text.size(), [&](size_t pos) {
+      line_starts_.push_back(base + pos + 1);
+    });
+    scanned_ += text.size();
+  });
+}
+
+line_index::position line_index::locate(size_t offset) const noexcept {
+  auto next_line =
+      std::upper_bound(line_starts_.begin(), line_starts_.end(), offset);
+  auto line = static_cast<size_t>(next_line - line_starts_.begin());
+  return {.line = line, .column = offset - *(next_line - 1) + 1};
+}
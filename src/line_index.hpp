@@ -0,0 +1,36 @@
+#pragma once
+
+#include "char_stream.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// Turns stream offsets into line and column numbers on demand. Newlines are
+// only looked for when a position is asked for, and only in the part of the
+// stream that hasn't been scanned yet, so parsing itself pays nothing.
+class line_index {
+public:
+  // 1 based; the column counts bytes
+  struct position {
+    size_t line;
+    size_t column;
+  };
+
+  // Scans whatever the stream has buffered since the last call, which must
+  // come before char_stream::discard_consumed frees any of it
+  void update(const char_stream &stream);
+
+  // `offset` must be in the part already scanned
+  position locate(size_t offset) const noexcept;
+  position locate(const char_stream &stream, size_t offset) {
+    update(stream);
+    return locate(offset);
+  }
+
+  size_t scanned() const noexcept { return scanned_; }
+
+private:
+  // offset of the first byte of each line
+  std::vector<size_t> line_starts_{0};
+  size_t scanned_{0};
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "xml.hpp"
+
+#include <optional>
+#include <string_view>
+
+// Parser for many small documents in a row, such as messages off a bus.
+// Going through read_string and parse_xml for each one sets up a stream
+// coroutine, copies the message into a fresh buffer and builds a new
+// context every time; this reads each message where it is and keeps the
+// context, namespace URIs included, from one to the next. Parser frames
+// come from the frame_pool, so once warmed up a message costs no
+// allocation beyond what its own names and namespace declarations need.
+namespace xml {
+template <config Config = config{}> class message_parser {
+public:
+  using parser_type = configurable_xml_parser<Config>;
+
+  // Names are interned into `names` when given, and keep their id from one
+  // message to the next
+  explicit message_parser(name_table *names = nullptr)
+      : stream_{std::string_view{}} {
+    ctx_.names = names;
+  }
+  message_parser(const message_parser &) = delete;
+  message_parser &operator=(const message_parser &) = delete;
+
+  // Starts parsing `message`, which must stay alive and unchanged while its
+  // events are read. The events are valid until the next call. As nothing
+  // is buffered, limits.max_buffered_bytes doesn't apply.
+  parser_type &parse(std::string_view message) {
+    parser_.reset();
+    stream_ = char_stream{message};
+    return parser_.emplace(parse_xml<Config>(stream_, ctx_));
+  }
+
+  // Limits and the error of the last message
+  context &ctx() noexcept { return ctx_; }
+  const context &ctx() const noexcept { return ctx_; }
+  char_stream &stream() noexcept { return stream_; }
+
+private:
+  char_stream stream_;
+  context ctx_;
+  // last, it refers to the others
+  std::optional<parser_type> parser_;
+};
+} // namespace xml
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "string_map.hpp"
+
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace xml {
+using name_id = std::uint32_t;
+constexpr inline name_id no_name = static_cast<name_id>(-1);
+
+// Name to id function known at compile time, see schema.hpp
+struct name_recognizer {
+  name_id (*lookup)(std::string_view) noexcept;
+};
+
+// Interns tag and attribute names into small integers.
+// Lookups through a const table are safe from any number of threads. A table
+// can be stacked on top of a shared, read-only one: names known to the base
+// keep their id, new ones are numbered after it.
+class name_table {
+public:
+  name_table() = default;
+  name_table(std::initializer_list<std::string_view> seed) {
+    for (auto name : seed) {
+      intern(name);
+    }
+  }
+  explicit name_table(std::shared_ptr<const name_table> base) noexcept
+      : base_{std::move(base)}, first_id_{base_ ? base_->size() : 0} {}
+
+  name_table(const name_table &) = delete;
+  name_table(name_table &&) noexcept = default;
+  name_table &operator=(const name_table &) = delete;
+  name_table &operator=(name_table &&) noexcept = default;
+
+  name_id find(std::string_view name) const noexcept {
+    if (base_ != nullptr) {
+      if (auto id = base_->find(name); id != no_name) {
+        return id;
+      }
+    }
+    auto it = ids_.find(name);
+    return it == ids_.end() ? no_name : it->second;
+  }
+
+  name_id intern(std::string_view name) {
+    if (auto id = find(name); id != no_name) {
+      return id;
+    }
+    auto id = static_cast<name_id>(size());
+    // node based map: the key never moves, so the reverse table can view it
+    auto it = ids_.emplace(std::string{name}, id).first;
+    names_.push_back(it->first);
+    return id;
+  }
+
+  std::string_view name(name_id id) const noexcept {
+    if (id < first_id_) {
+      return base_->name(id);
+    }
+    return id - first_id_ < names_.size() ? names_[id - first_id_]
+                                          : std::string_view{};
+  }
+
+  name_id size() const noexcept {
+    return first_id_ + static_cast<name_id>(names_.size());
+  }
+
+private:
+  std::shared_ptr<const name_table> base_;
+  name_id first_id_{0};
+  string_map<std::string, name_id> ids_;
+  std::vector<std::string_view> names_;
+};
+} // namespace xml
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "name_table.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace xml {
+constexpr inline std::string_view xml_namespace_uri =
+    "http://www.w3.org/XML/1998/namespace";
+constexpr inline std::string_view xmlns_namespace_uri =
+    "http://www.w3.org/2000/xmlns/";
+
+inline std::string_view name_prefix(std::string_view qualified) noexcept {
+  auto colon = qualified.find(':');
+  return colon == std::string_view::npos ? std::string_view{}
+                                         : qualified.substr(0, colon);
+}
+
+inline std::string_view local_name(std::string_view qualified) noexcept {
+  auto colon = qualified.find(':');
+  return colon == std::string_view::npos ? qualified
+                                         : qualified.substr(colon + 1);
+}
+
+// Prefix to namespace bindings in scope at the current element. Bindings are
+// only added by xmlns attributes, so the stack stays tiny and a lookup is a
+// short backward scan.
+class namespace_scopes {
+public:
+  // Namespace ids are the name ids of their URI. Without a name table in
+  // the context, URIs are interned here instead.
+  name_table uris;
+
+  void open() noexcept { depth_++; }
+  void close() noexcept {
+    while (!bindings_.empty() && bindings_.back().depth == depth_) {
+      bindings_.pop_back();
+    }
+    depth_--;
+  }
+  // Closes every scope opened past `depth`
+  void close_to(std::size_t depth) noexcept {
+    while (depth_ > depth) {
+      close();
+    }
+  }
+
+  // The empty prefix declares the default namespace
+  void declare(std::string_view prefix, name_id uri) {
+    bindings_.push_back({std::string{prefix}, uri, depth_});
+  }
+
+  // no_name if the prefix isn't bound
+  name_id find(std::string_view prefix) const noexcept {
+    for (auto it = bindings_.rbegin(); it != bindings_.rend(); ++it) {
+      if (it->prefix == prefix) {
+        return it->uri;
+      }
+    }
+    return no_name;
+  }
+
+  void reset() noexcept {
+    bindings_.clear();
+    depth_ = 0;
+  }
+
+private:
+  struct binding {
+    std::string prefix;
+    name_id uri;
+    std::size_t depth;
+  };
+  std::vector<binding> bindings_;
+  std::size_t depth_{0};
+};
+} // namespace xml
@@ -0,0 +1,171 @@
+#include "parallel.hpp"
+
+#include <algorithm>
+
+namespace xml {
+task_pool::task_pool(std::size_t threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (std::size_t i = 0; i < threads; ++i) {
+    workers_.push_back(std::make_unique<worker>());
+  }
+  for (std::size_t i = 1; i < threads; ++i) {
+    threads_.emplace_back([this, i] { serve_(i); });
+  }
+}
+
+task_pool::~task_pool() {
+  {
+    std::lock_guard lock{state_mutex_};
+    stopping_ = true;
+  }
+  started_.notify_all();
+  // before the members they use go away
+  threads_.clear();
+}
+
+void task_pool::walk(tag &root, visit_fn visit, void *data) {
+  std::lock_guard walking{walk_mutex_};
+  visit_ = visit;
+  data_ = data;
+  workers_[0]->local.push_back({&root, 1});
+  pending_.store(1, std::memory_order_relaxed);
+  {
+    std::lock_guard lock{state_mutex_};
+    running_ = threads_.size();
+    generation_++;
+  }
+  started_.notify_all();
+
+  work_(0);
+
+  std::unique_lock lock{state_mutex_};
+  finished_.wait(lock, [&] { return running_ == 0; });
+}
+
+void task_pool::serve_(std::size_t index) {
+  std::size_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock lock{state_mutex_};
+      started_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+      if (stopping_) {
+        return;
+      }
+      seen = generation_;
+    }
+    work_(index);
+    std::lock_guard lock{state_mutex_};
+    if (--running_ == 0) {
+      finished_.notify_all();
+    }
+  }
+}
+
+void task_pool::work_(std::size_t index) {
+  auto &self = *workers_[index];
+  // only the thread starting the walk has work from the start
+  bool holding = !self.local.empty();
+  for (;;) {
+    if (!holding && !take_(index)) {
+      return;
+    }
+    // depth first, so `local` stays as short as the tree is deep
+    while (!self.local.empty()) {
+      auto &top = self.local.back();
+      tag &node = *top.first;
+      if (--top.count == 0) {
+        self.local.pop_back();
+      } else {
+        ++top.first;
+      }
+      visit_(data_, node, index);
+      // after the visit, which may have changed them
+      if (!node.children.empty()) {
+        self.local.push_back({node.children.data(), node.children.size()});
+      }
+      if (idle_.load(std::memory_order_relaxed) != 0) {
+        offer_(self);
+      }
+    }
+    if (pending_.fetch_sub(1, std::memory_order_release) == 1) {
+      announce_();
+    }
+    holding = false;
+  }
+}
+
+bool task_pool::take_(std::size_t index) {
+  idle_.fetch_add(1, std::memory_order_relaxed);
+  for (;;) {
+    // read before looking, so that news from after the look ends the wait
+    auto seen = news_.load(std::memory_order_acquire);
+    // its own offer first, then the others in turn
+    for (std::size_t i = 0; i < workers_.size(); ++i) {
+      auto &victim = *workers_[(index + i) % workers_.size()];
+      if (!victim.has_offer.load(std::memory_order_relaxed)) {
+        continue;
+      }
+      std::lock_guard lock{victim.mutex};
+      if (victim.offered) {
+        // the range keeps its place in pending_, it just changes hands
+        workers_[index]->local.push_back(*victim.offered);
+        victim.offered.reset();
+        victim.has_offer.store(false, std::memory_order_relaxed);
+        idle_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    if (pending_.load(std::memory_order_acquire) == 0) {
+      idle_.fetch_sub(1, std::memory_order_relaxed);
+      return false;
+    }
+    news_.wait(seen, std::memory_order_acquire);
+  }
+}
+
+void task_pool::offer_(worker &self) {
+  if (self.has_offer.load(std::memory_order_relaxed) || self.local.empty()) {
+    return;
+  }
+  // the range nearest the root, which has the most below it
+  auto &bottom = self.local.front();
+  range given;
+  if (bottom.count > 1) {
+    // weigh each sibling by its children, and give away the back half
+    auto weight = [&](std::size_t i) {
+      return 1 + bottom.first[i].children.size();
+    };
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < bottom.count; ++i) {
+      total += weight(i);
+    }
+    std::size_t kept = 1;
+    for (auto sum = weight(0); kept + 1 < bottom.count && 2 * sum < total;
+         ++kept) {
+      sum += weight(kept);
+    }
+    given = {bottom.first + kept, bottom.count - kept};
+    bottom.count = kept;
+  } else if (self.local.size() > 1) {
+    given = bottom;
+    self.local.erase(self.local.begin());
+  } else {
+    // a single node, next in line
+    return;
+  }
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  {
+    std::lock_guard lock{self.mutex};
+    self.offered = given;
+    self.has_offer.store(true, std::memory_order_relaxed);
+  }
+  announce_();
+}
+
+void task_pool::announce_() {
+  news_.fetch_add(1, std::memory_order_release);
+  news_.notify_all();
+}
+} // namespace xml
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "xml.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Walking a document tree on several threads, for work on the nodes of a
+// built tree that costs more than the walk itself: checks, extraction,
+// hashing, rewriting.
+namespace xml {
+// Threads that split up a tree between them. Each walks its share depth
+// first, and hands the biggest piece it has left, the one nearest the root,
+// to whichever thread runs out of work: sibling ranges are cut in two by the
+// sizes of the subtrees under them, so a thief takes about half of what's
+// left. The thread that starts a walk takes part in it. One walk runs at a
+// time; starting another from inside a walk deadlocks.
+class task_pool {
+public:
+  // Visits one node; the last argument is the index of the thread, below
+  // size()
+  using visit_fn = void (*)(void *data, tag &node, std::size_t thread);
+
+  // `threads` in all, the caller's included; 0 for one per core
+  explicit task_pool(std::size_t threads = 0);
+  ~task_pool();
+
+  task_pool(const task_pool &) = delete;
+  task_pool &operator=(const task_pool &) = delete;
+
+  std::size_t size() const noexcept { return workers_.size(); }
+
+  // Calls visit(data, node, thread) on `root` and everything below it, each
+  // node before its children. Returns once every node is done.
+  void walk(tag &root, visit_fn visit, void *data);
+
+private:
+  // Consecutive siblings
+  struct range {
+    tag *first;
+    std::size_t count;
+  };
+
+  struct alignas(64) worker {
+    std::mutex mutex;
+    // a range given away, for any thread to take
+    std::optional<range> offered;
+    std::atomic<bool> has_offer{false};
+    // ranges this thread walks on its own, nearest the root first
+    std::vector<range> local;
+  };
+
+  void serve_(std::size_t index);
+  void work_(std::size_t index);
+  bool take_(std::size_t index);
+  void offer_(worker &self);
+  // wakes the threads waiting in take_
+  void announce_();
+
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::vector<std::jthread> threads_;
+
+  // serializes walks
+  std::mutex walk_mutex_;
+  // hands a walk to the threads and waits for them to leave it
+  std::mutex state_mutex_;
+  std::condition_variable started_;
+  std::condition_variable finished_;
+  std::size_t generation_{0};
+  std::size_t running_{0};
+  bool stopping_{false};
+
+  visit_fn visit_{nullptr};
+  void *data_{nullptr};
+  // threads holding work plus ranges given away: the walk is over at 0
+  std::atomic<std::size_t> pending_{0};
+  // threads looking for work
+  std::atomic<std::size_t> idle_{0};
+  // bumped on every offer and when the walk is over, for idle threads to
+  // wait on
+  std::atomic<std::uint32_t> news_{0};
+};
+
+namespace detail {
+// Keeps the results of different threads on different cache lines
+template <class T> struct alignas(64) padded {
+  T value;
+};
+
+template <class Node, class F>
+void walk_nodes(task_pool &pool, Node &root, F &&f) {
+  using function = std::remove_reference_t<F>;
+  pool.walk(
+      const_cast<tag &>(root),
+      [](void *data, tag &node, std::size_t thread) {
+        auto &f = *static_cast<function *>(data);
+        if constexpr (std::is_invocable_v<function &, Node &, std::size_t>) {
+          f(static_cast<Node &>(node), thread);
+        } else {
+          f(static_cast<Node &>(node));
+        }
+      },
+      const_cast<void *>(static_cast<const void *>(std::addressof(f))));
+}
+} // namespace detail
+
+// Calls f(const tag &) on `root` and every node below it, from the threads
+// of `pool` and in no particular order. f may also take the index of the
+// calling thread as a second argument. It runs concurrently with itself and
+// must not throw.
+template <class F>
+void parallel_for_each(task_pool &pool, const tag &root, F &&f) {
+  detail::walk_nodes(pool, root, f);
+}
+
+// Folds map(node) over the nodes below `root`, and root itself, that are
+// named `name`. Each thread starts from a copy of `init` and the partial
+// results are then combined, so `init` must leave reduce(init, x) == x and
+// reduce must not care about order, like a sum or a maximum.
+template <class T, class Map, class Reduce>
+T parallel_map_reduce(task_pool &pool, const tag &root, std::string_view name,
+                      T init, Map &&map, Reduce &&reduce) {
+  std::vector<detail::padded<T>> partial(pool.size(), {init});
+  detail::walk_nodes(pool, root, [&](const tag &node, std::size_t thread) {
+    if (node.name == name) {
+      auto &value = partial[thread].value;
+      value = reduce(std::move(value), map(node));
+    }
+  });
+  for (auto &p : partial) {
+    init = reduce(std::move(init), std::move(p.value));
+  }
+  return init;
+}
+
+// Calls f(tag &) on `root` and every node below it, like parallel_for_each.
+// f may change the node it gets, its children included, and the children
+// it leaves are visited after it; it must not touch any other node.
+template <class F> void parallel_transform(task_pool &pool, tag &root, F &&f) {
+  detail::walk_nodes(pool, root, f);
+}
+} // namespace xml
@@ -0,0 +1,37 @@
+#include "pipeline.hpp"
+
+#include <cerrno>
+
+#include <unistd.h>
+
+namespace xml {
+namespace detail {
+bool read_blocks(int fd, block_queue &full, block_queue &free) {
+  bool ok = true;
+  while (auto block = free.pop()) {
+    auto &buffer = **block;
+    buffer.resize(buffer.capacity());
+    ssize_t n;
+    do {
+      n = ::read(fd, buffer.data(), buffer.size());
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+      ok = n == 0;
+      break;
+    }
+    buffer.resize(static_cast<std::size_t>(n));
+    full.push(*block);
+  }
+  full.close();
+  return ok;
+}
+
+char_stream stream_blocks(block_queue &full, block_queue &free) {
+  while (auto block = full.pop()) {
+    co_yield std::string_view{**block};
+    free.push(*block);
+  }
+  co_return true;
+}
+} // namespace detail
+} // namespace xml
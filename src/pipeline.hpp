@@ -0,0 +1,183 @@
+#pragma once
+
+#include "spsc_queue.hpp"
+#include "xml.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace xml {
+// A run of consecutive events along with the text they refer to. Batches
+// share the chunks of the parser's buffer that their events point into, so
+// they outlive the parser's buffer without copying it.
+template <config Config> struct event_batch {
+  using event_type = typename configurable_xml_parser<Config>::event_type;
+
+  // Position of the batch in the document
+  std::size_t index{0};
+  std::vector<event_type> events;
+  // freed once the batch is cleared, if the parser is past them too
+  std::vector<std::shared_ptr<const char[]>> text;
+
+  void clear() noexcept {
+    events.clear();
+    text.clear();
+  }
+};
+
+struct pipeline_options {
+  // Batches are cut after this many events, but only between two children
+  // of the root element so that each record reaches a single consumer
+  std::size_t batch_events{1024};
+  std::size_t consumers{1};
+  // Batches in flight per consumer
+  std::size_t queue_depth{8};
+  std::size_t read_block_size{1 << 16};
+  std::size_t read_blocks{8};
+};
+
+namespace detail {
+using block_queue = spsc_queue<std::string *>;
+
+// Reads `fd` into blocks taken from `free` until the end of the file, then
+// closes `full`. False if a read fails.
+bool read_blocks(int fd, block_queue &full, block_queue &free);
+// Stream over the blocks of read_blocks, handing each one back once copied
+char_stream stream_blocks(block_queue &full, block_queue &free);
+} // namespace detail
+
+// Parses `fd` on three kinds of threads: one reads the file, one parses it
+// and `options.consumers` threads call `consume(const event_batch<Config> &)`
+// on batches of events. With a single consumer the batches arrive in order,
+// otherwise they are dealt out round robin and `consume` must be thread
+// safe. Returns false if the file can't be read or doesn't parse, with the
+// parse error in ctx.
+template <config Config = config{}, class Consumer>
+bool run_pipeline(int fd, Consumer &&consume, context &ctx,
+                  pipeline_options options = {}) {
+  using batch = event_batch<Config>;
+  struct lane {
+    spsc_queue<batch *> full;
+    spsc_queue<batch *> free;
+    std::vector<batch> batches;
+
+    explicit lane(std::size_t depth)
+        : full{depth}, free{depth}, batches(depth) {
+      for (auto &b : batches) {
+        free.push(&b);
+      }
+    }
+  };
+
+  auto consumers = options.consumers == 0 ? 1 : options.consumers;
+  std::vector<std::unique_ptr<lane>> lanes;
+  for (std::size_t i = 0; i < consumers; ++i) {
+    lanes.push_back(std::make_unique<lane>(options.queue_depth));
+  }
+
+  detail::block_queue full_blocks{options.read_blocks};
+  detail::block_queue free_blocks{options.read_blocks};
+  std::vector<std::string> blocks(options.read_blocks);
+  for (auto &block : blocks) {
+    block.reserve(options.read_block_size);
+    free_blocks.push(&block);
+  }
+
+  bool read_ok = true;
+  std::jthread reader{[&] {
+    read_ok = detail::read_blocks(fd, full_blocks, free_blocks);
+  }};
+
+  std::vector<std::jthread> workers;
+  for (auto &l : lanes) {
+    workers.emplace_back([&consume, &l = *l] {
+      while (auto b = l.full.pop()) {
+        consume(std::as_const(**b));
+        (*b)->clear();
+        l.free.push(*b);
+      }
+    });
+  }
+
+  // A batch may only end where the depth is known
+  constexpr bool tracks_depth = Config.emit_tag_open &&
+                                Config.emit_tag_close &&
+                                Config.emit_tag_self_close;
+  std::size_t next_lane = 0;
+  std::size_t index = 0;
+  auto acquire = [&] {
+    // any consumer with room, else wait for the next in turn
+    for (std::size_t i = 0; i < lanes.size(); ++i) {
+      auto &l = *lanes[(next_lane + i) % lanes.size()];
+      if (auto b = l.free.try_pop()) {
+        next_lane = (next_lane + i) % lanes.size();
+        return *b;
+      }
+    }
+    return *lanes[next_lane]->free.pop();
+  };
+  auto send = [&](batch *b) {
+    b->index = index++;
+    lanes[next_lane]->full.push(b);
+    next_lane = (next_lane + 1) % lanes.size();
+  };
+
+  {
+    auto stream = detail::stream_blocks(full_blocks, free_blocks);
+    auto parser = parse_xml<Config>(stream, ctx);
+    batch *current = acquire();
+    auto hand_over = [&] {
+      stream.share_buffered(stream.discarded(), current->text);
+      send(current);
+      // the batch holds on to what it needs
+      stream.discard_consumed();
+    };
+    std::size_t depth = 0;
+    while (parser) {
+      current->events.push_back(parser.event());
+      if constexpr (tracks_depth) {
+        std::visit(
+            [&](const auto &e) {
+              using E = std::decay_t<decltype(e)>;
+              if constexpr (std::is_same_v<E, tag_open>) {
+                depth++;
+              } else if constexpr (std::is_same_v<E, tag_close> ||
+                                   std::is_same_v<E, tag_self_close>) {
+                depth--;
+              }
+            },
+            current->events.back());
+      }
+      if (current->events.size() >= options.batch_events &&
+          (!tracks_depth || depth <= 1)) {
+        hand_over();
+        current = acquire();
+      }
+    }
+    if (!current->events.empty()) {
+      hand_over();
+    }
+  }
+
+  // lets the reader stop early if the parse did
+  free_blocks.close();
+  for (auto &l : lanes) {
+    l->full.close();
+  }
+  reader.join();
+  workers.clear();
+  return read_ok && !ctx.error;
+}
+
+template <config Config = config{}, class Consumer>
+bool run_pipeline(int fd, Consumer &&consume, pipeline_options options = {}) {
+  context ctx;
+  return run_pipeline<Config>(fd, std::forward<Consumer>(consume), ctx,
+                              options);
+}
+} // namespace xml
@@ -0,0 +1,276 @@
+#pragma once
+
+#include "xml.hpp"
+
+#include <functional>
+
+// Callback interface to the event parser, for when the events are handled
+// right away. The handler gets the same events as configurable_xml_parser,
+// through whichever of these members it has:
+//
+//   on_tag_open(const tag_open &)
+//   on_tag_close(const tag_close &)
+//   on_tag_self_close()
+//   on_attribute(const tag_attribute &)
+//   on_content(const tag_content &)
+//   on_comment(const comment &)
+//   on_processing_instruction_begin(const processing_instruction_begin &)
+//   on_processing_instruction_end()
+//   on_error(const parse_error &)
+//
+// Events that Config leaves out or that the handler has no member for are
+// never built. The grammar, limits and error handling are those of
+// parse_xml, whose steps it goes through, but the parse is a plain loop
+// with no coroutine frames and no variant, so the handler can be inlined
+// into it.
+namespace xml {
+namespace detail {
+template <config Config, class Handler> class sax_parser {
+public:
+  sax_parser(char_stream &stream, Handler &handler, context &ctx) noexcept
+      : stream_{stream}, handler_{handler}, ctx_{ctx} {}
+
+  void parse() {
+    syntax::start_document<Config>(stream_, ctx_);
+    while (stream_) {
+      if (!syntax::find_opening_char(stream_)) {
+        break;
+      }
+      if (!tag_() && !recover_()) {
+        return;
+      }
+    }
+    // cut short between two elements
+    if (!syntax::end_document(stream_, ctx_)) {
+      recover_();
+    }
+  }
+
+private:
+  constexpr static bool wants_tag_open =
+      Config.emit_tag_open &&
+      requires(Handler &h, const tag_open &e) { h.on_tag_open(e); };
+  constexpr static bool wants_tag_close =
+      Config.emit_tag_close &&
+      requires(Handler &h, const tag_close &e) { h.on_tag_close(e); };
+  constexpr static bool wants_tag_self_close =
+      Config.emit_tag_self_close &&
+      requires(Handler &h) { h.on_tag_self_close(); };
+  constexpr static bool wants_attribute =
+      Config.emit_tag_attribute &&
+      requires(Handler &h, const tag_attribute &e) { h.on_attribute(e); };
+  constexpr static bool wants_content =
+      Config.emit_tag_content &&
+      requires(Handler &h, const tag_content &e) { h.on_content(e); };
+  constexpr static bool wants_comment =
+      Config.emit_comments &&
+      requires(Handler &h, const comment &e) { h.on_comment(e); };
+  constexpr static bool wants_pi_begin =
+      Config.emit_processing_instruction_begin &&
+      requires(Handler &h, const processing_instruction_begin &e) {
+        h.on_processing_instruction_begin(e);
+      };
+  constexpr static bool wants_pi_end =
+      Config.emit_processing_instruction_end &&
+      requires(Handler &h) { h.on_processing_instruction_end(); };
+  constexpr static bool wants_error =
+      recovers_from_errors(Config) &&
+      requires(Handler &h, const parse_error &e) { h.on_error(e); };
+
+  // Where a nested step failed and parsing can go on: true if it does
+  bool recover_() {
+    if constexpr (recovers_from_errors(Config)) {
+      if constexpr (wants_error) {
+        handler_.on_error(*ctx_.error);
+      }
+      syntax::skip_broken_markup(stream_, ctx_);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  bool tag_() {
+    char c;
+    if (!syntax::next_char(stream_, ctx_, c)) {
+      return false;
+    }
+    switch (c) {
+    case '?':
+      return processing_instruction_();
+    case '/':
+      // outside every element, as content_ takes the others
+      return syntax::fail(stream_, ctx_, "closing tag without an opening one");
+    case '!': {
+      syntax::declaration_kind kind;
+      std::string_view text;
+      if (!syntax::next_char(stream_, ctx_, c) ||
+          !syntax::declaration(stream_, ctx_, kind, text)) {
+        return false;
+      }
+      if (kind == syntax::declaration_kind::comment) {
+        if constexpr (wants_comment) {
+          handler_.on_comment(comment{text});
+        }
+        stream_.advance(3);
+      } else if (kind == syntax::declaration_kind::cdata) {
+        if constexpr (wants_content) {
+          if (!text.empty()) {
+            handler_.on_content(tag_content{text, true});
+          }
+        }
+        stream_.advance(3);
+      }
+      return true;
+    }
+    default: {
+      if (!syntax::enter_element(stream_, ctx_)) {
+        return false;
+      }
+      DEFER { ctx_.depth--; };
+      return element_();
+    }
+    }
+  }
+
+  bool processing_instruction_() {
+    std::string_view name;
+    if (!syntax::instruction_name(stream_, ctx_, name)) {
+      return false;
+    }
+    if constexpr (wants_pi_begin) {
+      handler_.on_processing_instruction_begin(
+          processing_instruction_begin{name});
+    }
+    for (bool ended = false;;) {
+      if (!syntax::next_in_instruction(stream_, ctx_, ended)) {
+        return false;
+      }
+      if (ended) {
+        break;
+      }
+      if (!attribute_()) {
+        return false;
+      }
+    }
+    if constexpr (wants_pi_end) {
+      handler_.on_processing_instruction_end();
+    }
+    return true;
+  }
+
+  bool element_() {
+    std::string_view name;
+    if (!syntax::start_tag_name<Config>(stream_, ctx_, name)) {
+      return false;
+    }
+    if constexpr (wants_tag_open) {
+      handler_.on_tag_open(syntax::make_tag_open<Config>(ctx_, name));
+    }
+    std::size_t count = 0;
+    auto part = syntax::start_tag_part::attribute;
+    for (;;) {
+      if (!syntax::next_in_start_tag(stream_, ctx_, count, part)) {
+        return false;
+      }
+      if (part != syntax::start_tag_part::attribute) {
+        break;
+      }
+      if (!attribute_()) {
+        return false;
+      }
+    }
+    if (part == syntax::start_tag_part::end) {
+      return content_();
+    }
+    if constexpr (wants_tag_self_close) {
+      handler_.on_tag_self_close();
+    }
+    syntax::close_element<Config>(ctx_);
+    return true;
+  }
+
+  bool attribute_() {
+    syntax::attribute_span span;
+    if (!syntax::attribute(stream_, ctx_, span)) {
+      return false;
+    }
+    if constexpr (wants_attribute) {
+      handler_.on_attribute(
+          syntax::make_attribute<Config>(stream_, ctx_, span));
+    }
+    return true;
+  }
+
+  bool content_() {
+    while (stream_) {
+      std::string_view text;
+      if (!syntax::content_text(stream_, ctx_, text)) {
+        return false;
+      }
+      if constexpr (wants_content) {
+        if (!xml::is_blank(text)) {
+          handler_.on_content(tag_content{text});
+        }
+      }
+
+      bool end_tag;
+      if (!syntax::content_markup(stream_, ctx_, end_tag)) {
+        return false;
+      }
+      if (end_tag) {
+        std::string_view name;
+        std::size_t target;
+        if (!syntax::end_tag_name(stream_, ctx_, name) ||
+            !syntax::match_end_tag<Config>(stream_, ctx_, name, target)) {
+          return false;
+        }
+        if (target == ctx_.elements.size()) {
+          tag_close_(name);
+          return true;
+        }
+        auto error = syntax::mismatched_end_tag(stream_, ctx_, target);
+        if constexpr (wants_error) {
+          handler_.on_error(error);
+        }
+      } else if (!tag_() && !recover_()) {
+        return false;
+      }
+      // closed by an end tag that belongs further out
+      if (syntax::unwinding(ctx_)) {
+        tag_close_(ctx_.elements.innermost());
+        return true;
+      }
+    }
+    return true;
+  }
+
+  void tag_close_(std::string_view name) {
+    if constexpr (wants_tag_close) {
+      handler_.on_tag_close(syntax::make_tag_close<Config>(ctx_, name));
+    }
+    syntax::close_element<Config>(ctx_);
+  }
+
+  char_stream &stream_;
+  Handler &handler_;
+  context &ctx_;
+};
+} // namespace detail
+
+// Parses `stream`, calling the members of `handler` as events come. Returns
+// false if the parse failed, with the error in ctx.
+template <config Config = config{}, class Handler>
+bool sax_parse(char_stream &stream, Handler &&handler, context &ctx) {
+  detail::sax_parser<Config, std::remove_reference_t<Handler>> parser{
+      stream, handler, ctx};
+  parser.parse();
+  return !ctx.error;
+}
+
+template <config Config = config{}, class Handler>
+bool sax_parse(char_stream &stream, Handler &&handler) {
+  context ctx;
+  return sax_parse<Config>(stream, std::forward<Handler>(handler), ctx);
+}
+} // namespace xml
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "name_table.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace xml {
+template <std::size_t N> struct fixed_string {
+  char data[N]{};
+
+  constexpr fixed_string(const char (&str)[N]) noexcept {
+    std::copy_n(str, N, data);
+  }
+  constexpr std::string_view view() const noexcept { return {data, N - 1}; }
+};
+
+namespace detail {
+constexpr std::uint64_t schema_hash(std::string_view name,
+                                   std::uint64_t seed) noexcept {
+  std::uint64_t h = 14695981039346656037ull ^ seed;
+  for (char c : name) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+// Spreads every bit of x over all the others, so that nearby inputs give
+// unrelated outputs
+constexpr std::uint64_t schema_mix(std::uint64_t x) noexcept {
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+// Hash and displace: names are dispatched into buckets by the low bits of
+// their hash, then each bucket gets a displacement moving all its names to
+// free slots. The slot is a fresh hash of the hash and the displacement, so
+// names sharing a bucket land on unrelated slots for each displacement. If
+// some bucket can't be placed, everything starts over with another seed. A
+// lookup is one hash, two table reads and one compare.
+template <std::size_t N> struct perfect_hash {
+  constexpr static std::size_t buckets = std::bit_ceil(N == 0 ? 1 : N);
+  constexpr static std::size_t slots = 2 * buckets;
+  constexpr static std::uint32_t empty = static_cast<std::uint32_t>(-1);
+  // displacements tried for each bucket, and seeds tried in all
+  constexpr static std::uint32_t max_displacement = 64 * slots;
+  constexpr static std::uint64_t max_seed = 64;
+
+  std::uint64_t seed{0};
+  std::array<std::uint32_t, buckets> displacement{};
+  std::array<std::uint32_t, slots> index{};
+
+  constexpr std::uint64_t hash(std::string_view name) const noexcept {
+    return schema_mix(schema_hash(name, seed));
+  }
+  constexpr static std::size_t bucket_of(std::uint64_t h) noexcept {
+    return h & (buckets - 1);
+  }
+  constexpr static std::size_t slot_of(std::uint64_t h,
+                                       std::uint32_t d) noexcept {
+    return schema_mix(h + (d + 1) * 0x9E3779B97F4A7C15ull) & (slots - 1);
+  }
+
+  constexpr explicit perfect_hash(
+      const std::array<std::string_view, N> &names) {
+    for (std::size_t i = 0; i < N; ++i) {
+      if (std::find(names.begin(), names.begin() + i, names[i]) !=
+          names.begin() + i) {
+        throw "schema names must be unique";
+      }
+    }
+    while (!place_(names)) {
+      if (++seed == max_seed) {
+        throw "schema names can't be hashed without collisions";
+      }
+    }
+  }
+
+private:
+  constexpr bool place_(const std::array<std::string_view, N> &names) {
+    index.fill(empty);
+    displacement.fill(0);
+    std::array<std::uint64_t, N> hashes{};
+    std::array<std::size_t, N> order{};
+    for (std::size_t i = 0; i < N; ++i) {
+      hashes[i] = hash(names[i]);
+      order[i] = i;
+    }
+
+    std::array<std::size_t, buckets> sizes{};
+    for (auto h : hashes) {
+      sizes[bucket_of(h)]++;
+    }
+    // place the most crowded buckets first, while the table is still sparse
+    std::sort(order.begin(), order.end(), [&](std::size_t l, std::size_t r) {
+      auto bl = bucket_of(hashes[l]), br = bucket_of(hashes[r]);
+      return sizes[bl] != sizes[br] ? sizes[bl] > sizes[br] : bl < br;
+    });
+
+    for (std::size_t first = 0; first < N;) {
+      auto bucket = bucket_of(hashes[order[first]]);
+      auto last = first + sizes[bucket];
+      bool placed = false;
+      for (std::uint32_t d = 0; d < max_displacement && !placed; ++d) {
+        std::array<std::size_t, N> taken{};
+        bool fits = true;
+        for (auto i = first; i < last && fits; ++i) {
+          auto slot = slot_of(hashes[order[i]], d);
+          fits = index[slot] == empty &&
+                 std::find(taken.begin(), taken.begin() + (i - first),
+                           slot) == taken.begin() + (i - first);
+          taken[i - first] = slot;
+        }
+        if (fits) {
+          for (auto i = first; i < last; ++i) {
+            index[taken[i - first]] = static_cast<std::uint32_t>(order[i]);
+          }
+          displacement[bucket] = d;
+          placed = true;
+        }
+      }
+      if (!placed) {
+        return false;
+      }
+      first = last;
+    }
+    return true;
+  }
+};
+} // namespace detail
+
+// Compile-time set of known element and attribute names. lookup() maps a
+// name to its position in the list, or to no_name when it isn't part of it.
+// Pointing config::recognize_names at recognizer makes the parser use these
+// positions as name ids, with the context's name_table as the fallback for
+// unknown names.
+template <fixed_string... Names> struct schema {
+  constexpr static std::size_t size = sizeof...(Names);
+  constexpr static std::array<std::string_view, size> names{Names.view()...};
+
+  constexpr static name_id lookup(std::string_view name) noexcept {
+    if constexpr (size == 0) {
+      return no_name;
+    } else {
+      auto h = table_.hash(name);
+      auto d = table_.displacement[table_.bucket_of(h)];
+      auto i = table_.index[table_.slot_of(h, d)];
+      return i != table_.empty && names[i] == name ? i : no_name;
+    }
+  }
+
+  constexpr static name_recognizer recognizer{&lookup};
+
+  // E lists the names in the same order, followed by an enumerator for
+  // unknown names
+  template <class E> constexpr static E recognize(std::string_view name) {
+    auto id = lookup(name);
+    return static_cast<E>(id == no_name ? size : id);
+  }
+
+  // Table whose ids agree with lookup(), to intern the names outside the set
+  static name_table make_table() {
+    name_table table;
+    for (auto name : names) {
+      table.intern(name);
+    }
+    return table;
+  }
+
+private:
+  constexpr static detail::perfect_hash<size> table_{names};
+};
+} // namespace xml
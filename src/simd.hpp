@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Byte scanning kernels, 16 bytes at a time when SSE2 is available
+namespace simd {
+
+#if defined(__SSE2__)
+constexpr inline std::size_t width = 16;
+
+// Bit i is set when byte i of the block at `data` is one of Cs
+template <char... Cs> inline unsigned match_mask(const char *data) noexcept {
+  auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+  auto found = _mm_setzero_si128();
+  ((found = _mm_or_si128(found, _mm_cmpeq_epi8(block, _mm_set1_epi8(Cs)))),
+   ...);
+  return static_cast<unsigned>(_mm_movemask_epi8(found));
+}
+#endif
+
+// Position of the first byte equal to one of Cs, or size if there is none
+template <char... Cs>
+inline std::size_t find_any(const char *data, std::size_t size) noexcept {
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + width <= size; i += width) {
+    if (auto mask = match_mask<Cs...>(data + i); mask != 0) {
+      return i + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+  }
+#endif
+  for (; i < size; ++i) {
+    if (((data[i] == Cs) || ...)) {
+      return i;
+    }
+  }
+  return size;
+}
+
+// Calls func with the position of every byte equal to one of Cs, in order
+template <char... Cs, class F>
+inline void for_each(const char *data, std::size_t size, F &&func) {
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + width <= size; i += width) {
+    for (auto mask = match_mask<Cs...>(data + i); mask != 0; mask &= mask - 1) {
+      func(i + static_cast<std::size_t>(__builtin_ctz(mask)));
+    }
+  }
+#endif
+  for (; i < size; ++i) {
+    if (((data[i] == Cs) || ...)) {
+      func(i);
+    }
+  }
+}
+
+// Position of the first occurrence of the `n` bytes at `pattern`, or size if
+// there is none. Blocks are filtered on the first and last byte of the
+// pattern together, and only the candidates left are compared in full.
+inline std::size_t find_seq(const char *data, std::size_t size,
+                            const char *pattern, std::size_t n) noexcept {
+  if (n == 0) {
+    return 0;
+  }
+  if (n > size) {
+    return size;
+  }
+  // past the last place the pattern could start
+  auto starts = size - n + 1;
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  auto first = _mm_set1_epi8(pattern[0]);
+  auto last = _mm_set1_epi8(pattern[n - 1]);
+  for (; i + width <= starts; i += width) {
+    auto heads = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    auto tails = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(data + i + n - 1));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpeq_epi8(heads, first), _mm_cmpeq_epi8(tails, last))));
+    for (; mask != 0; mask &= mask - 1) {
+      auto at = i + static_cast<std::size_t>(__builtin_ctz(mask));
+      if (std::memcmp(data + at, pattern, n) == 0) {
+        return at;
+      }
+    }
+  }
+#endif
+  for (; i < starts; ++i) {
+    if (data[i] == pattern[0] && std::memcmp(data + i, pattern, n) == 0) {
+      return i;
+    }
+  }
+  return size;
+}
+
+// Position of the first byte that is none of Cs, or size if there is none
+template <char... Cs>
+inline std::size_t find_none(const char *data, std::size_t size) noexcept {
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + width <= size; i += width) {
+    if (auto mask = ~match_mask<Cs...>(data + i) & 0xFFFFu; mask != 0) {
+      return i + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+  }
+#endif
+  for (; i < size; ++i) {
+    if (((data[i] != Cs) && ...)) {
+      return i;
+    }
+  }
+  return size;
+}
+} // namespace simd
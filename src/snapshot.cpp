@@ -0,0 +1,272 @@
+#include "snapshot.hpp"
+
+#include "buffered_writer.hpp"
+#include "hash.hpp"
+
+#include <cstring>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace xml {
+namespace {
+namespace format = snapshot_format;
+
+struct snapshot_builder {
+  std::vector<format::node> nodes;
+  std::vector<format::attribute> attributes;
+  std::string strings;
+  bool overflow{false};
+
+  std::uint32_t narrow(std::size_t n) {
+    if (n > std::numeric_limits<std::uint32_t>::max()) {
+      overflow = true;
+    }
+    return static_cast<std::uint32_t>(n);
+  }
+
+  std::pair<std::uint32_t, std::uint32_t> add_string(std::string_view str) {
+    auto offset = narrow(strings.size());
+    strings += str;
+    narrow(strings.size());
+    return {offset, narrow(str.size())};
+  }
+
+  // Breadth first, so each node's children end up next to each other
+  void build(const tag &root) {
+    std::vector<const tag *> queue{&root};
+    nodes.push_back({});
+    for (std::size_t i = 0; i < queue.size(); ++i) {
+      const tag &current = *queue[i];
+
+      format::node n{};
+      std::tie(n.name_offset, n.name_size) = add_string(current.name);
+      std::tie(n.content_offset, n.content_size) =
+          add_string(current.content);
+
+      n.first_attribute = narrow(attributes.size());
+      n.attribute_count = narrow(current.attributes.size());
+      for (auto &attr : current.attributes) {
+        format::attribute a{};
+        std::tie(a.name_offset, a.name_size) = add_string(attr.name);
+        std::tie(a.value_offset, a.value_size) = add_string(attr.value);
+        attributes.push_back(a);
+      }
+
+      n.first_child = narrow(queue.size());
+      n.child_count = narrow(current.children.size());
+      for (auto &child : current.children) {
+        queue.push_back(&child);
+      }
+      nodes[i] = n;
+      nodes.resize(queue.size());
+    }
+  }
+};
+
+std::string_view bytes_of(const auto &vec) {
+  return {reinterpret_cast<const char *>(vec.data()),
+          vec.size() * sizeof(vec[0])};
+}
+
+bool in_strings(std::uint64_t string_bytes, std::uint32_t offset,
+                std::uint32_t size) {
+  return std::uint64_t{offset} + size <= string_bytes;
+}
+
+// Whether the tables describe the tree save_snapshot writes: every string
+// inside the string table, and the children and attributes of each node
+// right after those of the node before it. Children then always come after
+// their parent, so walking down ends.
+bool valid_tables(const format::header &header, const format::node *nodes,
+                  const format::attribute *attributes) {
+  std::uint64_t next_child = 1;
+  std::uint64_t next_attribute = 0;
+  for (std::uint32_t i = 0; i < header.node_count; ++i) {
+    auto &n = nodes[i];
+    if (!in_strings(header.string_bytes, n.name_offset, n.name_size) ||
+        !in_strings(header.string_bytes, n.content_offset, n.content_size) ||
+        n.first_child != next_child || n.first_attribute != next_attribute) {
+      return false;
+    }
+    next_child += n.child_count;
+    next_attribute += n.attribute_count;
+  }
+  if (next_child != header.node_count ||
+      next_attribute != header.attribute_count) {
+    return false;
+  }
+  for (std::uint32_t i = 0; i < header.attribute_count; ++i) {
+    auto &a = attributes[i];
+    if (!in_strings(header.string_bytes, a.name_offset, a.name_size) ||
+        !in_strings(header.string_bytes, a.value_offset, a.value_size)) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+bool save_snapshot(const tag &root, const char *path) {
+  snapshot_builder builder;
+  builder.build(root);
+  if (builder.overflow) {
+    return false;
+  }
+
+  auto nodes = bytes_of(builder.nodes);
+  auto attributes = bytes_of(builder.attributes);
+
+  format::header header{};
+  std::memcpy(header.magic, format::magic, sizeof(header.magic));
+  header.version = format::version;
+  header.byte_order = format::byte_order;
+  header.payload_size =
+      nodes.size() + attributes.size() + builder.strings.size();
+  header.node_count = static_cast<std::uint32_t>(builder.nodes.size());
+  header.attribute_count =
+      static_cast<std::uint32_t>(builder.attributes.size());
+  header.string_bytes = builder.strings.size();
+
+  // the sections are hashed as if they were one contiguous payload
+  fast_hasher checksum;
+  for (auto section : {nodes, attributes, std::string_view{builder.strings}}) {
+    checksum.update(section.data(), section.size());
+  }
+  header.checksum = checksum.finish();
+
+  int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok;
+  {
+    buffered_writer out{fd};
+    out.write({reinterpret_cast<const char *>(&header), sizeof(header)});
+    out.write(nodes);
+    out.write(attributes);
+    out.write(builder.strings);
+    ok = out.flush();
+  }
+  return ::close(fd) == 0 && ok;
+}
+
+std::optional<snapshot> snapshot::open(const char *path,
+                                       bool verify_checksum) {
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<std::size_t>(st.st_size) < sizeof(format::header)) {
+    ::close(fd);
+    return std::nullopt;
+  }
+  auto size = static_cast<std::size_t>(st.st_size);
+  void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return std::nullopt;
+  }
+
+  snapshot result{mapping, size};
+  auto &header = result.header_();
+  bool valid =
+      std::memcmp(header.magic, format::magic, sizeof(format::magic)) == 0 &&
+      header.version == format::version &&
+      header.byte_order == format::byte_order && header.node_count > 0 &&
+      header.payload_size == size - sizeof(format::header) &&
+      header.string_bytes <= header.payload_size &&
+      header.payload_size ==
+          header.node_count * sizeof(format::node) +
+              header.attribute_count * sizeof(format::attribute) +
+              header.string_bytes;
+  if (!valid) {
+    return std::nullopt;
+  }
+  if (verify_checksum &&
+      fast_hash(static_cast<const char *>(mapping) + sizeof(format::header),
+                header.payload_size) != header.checksum) {
+    return std::nullopt;
+  }
+  // a file can match its checksum and still point anywhere
+  if (!valid_tables(header, result.nodes_, result.attributes_)) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+snapshot::snapshot(void *mapping, std::size_t size) noexcept
+    : mapping_{mapping}, size_{size} {
+  auto base = static_cast<const char *>(mapping) + sizeof(format::header);
+  nodes_ = reinterpret_cast<const format::node *>(base);
+  attributes_ = reinterpret_cast<const format::attribute *>(
+      base + header_().node_count * sizeof(format::node));
+  strings_ = reinterpret_cast<const char *>(
+      attributes_ + header_().attribute_count);
+}
+
+snapshot::snapshot(snapshot &&other) noexcept
+    : mapping_{std::exchange(other.mapping_, nullptr)},
+      size_{std::exchange(other.size_, 0)}, nodes_{other.nodes_},
+      attributes_{other.attributes_}, strings_{other.strings_} {}
+
+snapshot &snapshot::operator=(snapshot &&other) noexcept {
+  std::swap(mapping_, other.mapping_);
+  std::swap(size_, other.size_);
+  std::swap(nodes_, other.nodes_);
+  std::swap(attributes_, other.attributes_);
+  std::swap(strings_, other.strings_);
+  return *this;
+}
+
+snapshot::~snapshot() noexcept {
+  if (mapping_ != nullptr) {
+    ::munmap(mapping_, size_);
+  }
+}
+
+std::optional<std::string_view>
+snapshot::node_view::attribute(std::string_view name) const {
+  for (auto attr : attributes()) {
+    if (attr.name() == name) {
+      return attr.value();
+    }
+  }
+  return std::nullopt;
+}
+
+tag snapshot::node_view::to_tag(name_table *names) const {
+  // the document root has no name, and no id either
+  auto id_of = [&](std::string_view name) {
+    return names != nullptr && !name.empty() ? names->intern(name) : no_name;
+  };
+  tag result{
+      .name = std::string{name()},
+      .id = id_of(name()),
+      .attributes = {},
+      .children = {},
+      .content = std::string{content()},
+  };
+  result.attributes.reserve(data_->attribute_count);
+  for (auto attr : attributes()) {
+    result.attributes.push_back({
+        .name = std::string{attr.name()},
+        .id = id_of(attr.name()),
+        .value = std::string{attr.value()},
+    });
+  }
+  result.children.reserve(data_->child_count);
+  for (auto child : children()) {
+    result.children.push_back(child.to_tag(names));
+  }
+  return result;
+}
+} // namespace xml
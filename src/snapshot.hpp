@@ -0,0 +1,174 @@
+#pragma once
+
+#include "xml.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Binary image of a DOM that is used in place through mmap.
+//
+// Layout: a header, then every node, then every attribute, then the strings.
+// Nodes are stored breadth first so the children of a node are contiguous,
+// and everything refers to everything else through 32 bit indices, which
+// makes the file position independent. Node 0 is the root.
+namespace xml::snapshot_format {
+constexpr inline char magic[8] = {'X', 'M', 'L', 'S', 'N', 'A', 'P', '\0'};
+constexpr inline std::uint32_t version = 1;
+constexpr inline std::uint32_t byte_order = 0x01020304;
+
+struct header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  // fast_hash of everything following the header
+  std::uint64_t checksum;
+  std::uint64_t payload_size;
+  std::uint32_t node_count;
+  std::uint32_t attribute_count;
+  std::uint64_t string_bytes;
+};
+
+struct node {
+  std::uint32_t name_offset;
+  std::uint32_t name_size;
+  std::uint32_t content_offset;
+  std::uint32_t content_size;
+  std::uint32_t first_attribute;
+  std::uint32_t attribute_count;
+  std::uint32_t first_child;
+  std::uint32_t child_count;
+};
+
+struct attribute {
+  std::uint32_t name_offset;
+  std::uint32_t name_size;
+  std::uint32_t value_offset;
+  std::uint32_t value_size;
+};
+
+static_assert(sizeof(header) % 8 == 0);
+static_assert(sizeof(node) == 32);
+static_assert(sizeof(attribute) == 16);
+} // namespace xml::snapshot_format
+
+namespace xml {
+
+// Writes `root` to `path`, false if the file can't be written or the
+// document doesn't fit 32 bit offsets
+bool save_snapshot(const tag &root, const char *path);
+
+class snapshot {
+  template <class T> class range {
+  public:
+    struct iterator {
+      const snapshot *owner;
+      std::uint32_t index;
+
+      T operator*() const noexcept { return {owner, index}; }
+      iterator &operator++() noexcept {
+        ++index;
+        return *this;
+      }
+      bool operator==(const iterator &) const noexcept = default;
+    };
+
+    range(const snapshot *owner, std::uint32_t first,
+          std::uint32_t count) noexcept
+        : owner_{owner}, first_{first}, count_{count} {}
+
+    iterator begin() const noexcept { return {owner_, first_}; }
+    iterator end() const noexcept { return {owner_, first_ + count_}; }
+    std::size_t size() const noexcept { return count_; }
+    bool empty() const noexcept { return count_ == 0; }
+    T operator[](std::size_t i) const noexcept {
+      return {owner_, static_cast<std::uint32_t>(first_ + i)};
+    }
+
+  private:
+    const snapshot *owner_;
+    std::uint32_t first_;
+    std::uint32_t count_;
+  };
+
+public:
+  class attribute_view {
+  public:
+    attribute_view(const snapshot *owner, std::uint32_t index) noexcept
+        : owner_{owner}, data_{&owner->attributes_[index]} {}
+
+    std::string_view name() const noexcept {
+      return owner_->string_(data_->name_offset, data_->name_size);
+    }
+    std::string_view value() const noexcept {
+      return owner_->string_(data_->value_offset, data_->value_size);
+    }
+
+  private:
+    const snapshot *owner_;
+    const snapshot_format::attribute *data_;
+  };
+
+  class node_view {
+  public:
+    node_view(const snapshot *owner, std::uint32_t index) noexcept
+        : owner_{owner}, data_{&owner->nodes_[index]} {}
+
+    std::string_view name() const noexcept {
+      return owner_->string_(data_->name_offset, data_->name_size);
+    }
+    std::string_view content() const noexcept {
+      return owner_->string_(data_->content_offset, data_->content_size);
+    }
+    range<attribute_view> attributes() const noexcept {
+      return {owner_, data_->first_attribute, data_->attribute_count};
+    }
+    range<node_view> children() const noexcept {
+      return {owner_, data_->first_child, data_->child_count};
+    }
+    std::optional<std::string_view> attribute(std::string_view name) const;
+
+    // Copies the subtree into a regular DOM. With a name table, names are
+    // interned and nodes carry their id as build_xml_doc's do.
+    tag to_tag(name_table *names = nullptr) const;
+
+  private:
+    const snapshot *owner_;
+    const snapshot_format::node *data_;
+  };
+
+  // Maps the file and checks its header, and that every index and string
+  // range in it stays inside the file, which reads the node and attribute
+  // tables. Verifying the checksum reads the whole file, skip it when the
+  // file is trusted.
+  static std::optional<snapshot> open(const char *path,
+                                      bool verify_checksum = true);
+
+  snapshot(const snapshot &) = delete;
+  snapshot &operator=(const snapshot &) = delete;
+  snapshot(snapshot &&other) noexcept;
+  snapshot &operator=(snapshot &&other) noexcept;
+  ~snapshot() noexcept;
+
+  node_view root() const noexcept { return {this, 0}; }
+  std::size_t node_count() const noexcept { return header_().node_count; }
+
+private:
+  snapshot(void *mapping, std::size_t size) noexcept;
+
+  const snapshot_format::header &header_() const noexcept {
+    return *static_cast<const snapshot_format::header *>(mapping_);
+  }
+  std::string_view string_(std::uint32_t offset,
+                           std::uint32_t size) const noexcept {
+    return {strings_ + offset, size};
+  }
+
+  void *mapping_{nullptr};
+  std::size_t size_{0};
+  const snapshot_format::node *nodes_{nullptr};
+  const snapshot_format::attribute *attributes_{nullptr};
+  const char *strings_{nullptr};
+};
+} // namespace xml
@@ -0,0 +1,178 @@
+#include "split.hpp"
+
+#include "buffered_writer.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <thread>
+
+namespace xml {
+namespace {
+constexpr auto npos = std::string_view::npos;
+
+// The '>' ending the start tag at `open`, skipping over quoted values
+std::size_t start_tag_end(std::string_view document, std::size_t open) {
+  for (auto pos = open + 1;;) {
+    pos += simd::find_any<'>', '"', '\''>(document.data() + pos,
+                                          document.size() - pos);
+    if (pos >= document.size() || document[pos] == '>') {
+      return pos < document.size() ? pos : npos;
+    }
+    auto quote_end = document.find(document[pos], pos + 1);
+    if (quote_end == npos) {
+      return npos;
+    }
+    pos = quote_end + 1;
+  }
+}
+
+// The '>' ending the doctype at `open`, past its internal subset if any. The
+// stream borrows the document, so its positions are offsets into it.
+std::size_t doctype_end(std::string_view document, std::size_t open) {
+  auto stream = read_string(document);
+  stream.seek(open + 2);
+  auto end = syntax::declaration_end(stream);
+  return end == npos ? npos : end - 1;
+}
+} // namespace
+
+record_layout find_records(std::string_view document) {
+  record_layout layout;
+  auto fail = [&](std::size_t offset, std::string_view reason) {
+    layout.error = parse_error{offset, reason};
+    return std::move(layout);
+  };
+
+  std::size_t depth = 0;
+  bool seen_root = false;
+  for (std::size_t pos = 0;;) {
+    auto open =
+        pos + simd::find_any<'<'>(document.data() + pos, document.size() - pos);
+    if (open >= document.size()) {
+      break;
+    }
+    auto markup = document.substr(open);
+    bool closing = markup.starts_with("</");
+    bool opening = false;
+    std::size_t end;
+    if (markup.starts_with("<!--")) {
+      end = document.find("-->", open + 4);
+      pos = end + 3;
+    } else if (markup.starts_with("<?")) {
+      end = document.find("?>", open + 2);
+      pos = end + 2;
+    } else if (markup.starts_with("<![CDATA[")) {
+      end = document.find("]]>", open + 9);
+      pos = end + 3;
+    } else if (markup.starts_with("<!")) {
+      end = doctype_end(document, open);
+      pos = end + 1;
+    } else if (closing) {
+      end = document.find('>', open + 2);
+      pos = end + 1;
+    } else {
+      opening = true;
+      end = start_tag_end(document, open);
+      pos = end + 1;
+    }
+    if (end == npos) {
+      return fail(open, "unterminated markup");
+    }
+
+    if (closing) {
+      if (depth == 0) {
+        return fail(open, "closing tag without an opening one");
+      }
+      if (--depth == 1) {
+        layout.record_ends.push_back(pos);
+      } else if (depth == 0) {
+        layout.body_end = open;
+        break;
+      }
+    } else if (opening) {
+      bool self_closing = document[end - 1] == '/';
+      if (depth == 0) {
+        if (seen_root) {
+          return fail(open, "more than one root element");
+        }
+        seen_root = true;
+        layout.body_begin = pos;
+        if (self_closing) {
+          // no records, the whole document is the prolog
+          layout.body_end = pos;
+          break;
+        }
+      } else if (depth == 1 && self_closing) {
+        layout.record_ends.push_back(pos);
+      }
+      depth += !self_closing;
+    }
+  }
+  if (!seen_root) {
+    return fail(document.size(), "no root element");
+  }
+  if (depth > 0) {
+    return fail(document.size(), "root element isn't closed");
+  }
+  return layout;
+}
+
+std::vector<std::size_t> cut_records(const record_layout &layout,
+                                     std::size_t count) {
+  std::vector<std::size_t> cuts{layout.body_begin};
+  auto &ends = layout.record_ends;
+  auto body = layout.body_end - layout.body_begin;
+  for (std::size_t i = 1; i < count && !ends.empty(); ++i) {
+    auto target = layout.body_begin + body / count * i;
+    // the first record ending past the target, but never the last one so
+    // that trailing text stays with it: a target inside the last record
+    // cuts just before it
+    auto last = ends.end() - 1;
+    auto it = std::upper_bound(ends.begin(), last, target);
+    if (it == last && it != ends.begin()) {
+      it = std::prev(it);
+    }
+    if (it != last && *it > cuts.back()) {
+      cuts.push_back(*it);
+    }
+  }
+  cuts.push_back(layout.body_end);
+  return cuts;
+}
+
+bool write_shards(std::string_view document, const record_layout &layout,
+                  std::span<const std::size_t> cuts, std::span<const int> fds,
+                  std::size_t threads) {
+  auto shards = std::min(cuts.size() - 1, fds.size());
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  auto prolog = document.substr(0, layout.body_begin);
+  auto epilog = document.substr(layout.body_end);
+
+  std::atomic<std::size_t> next{0};
+  std::atomic<bool> ok{true};
+  auto work = [&] {
+    for (auto i = next++; i < shards; i = next++) {
+      // the record runs are big enough to bypass the buffer
+      buffered_writer out{fds[i]};
+      out.write(prolog);
+      out.write(document.substr(cuts[i], cuts[i + 1] - cuts[i]));
+      out.write(epilog);
+      if (!out.flush()) {
+        ok = false;
+      }
+    }
+  };
+  {
+    std::vector<std::jthread> workers;
+    for (std::size_t i = 1; i < std::min(threads, shards); ++i) {
+      workers.emplace_back(work);
+    }
+    work();
+  }
+  return ok;
+}
+} // namespace xml
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "xml.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Cutting a `<root><record/>...</root>` document into smaller well formed
+// documents along its records, without parsing them.
+//
+// A shard is the prolog up to the end of the root start tag, a run of
+// consecutive records copied as is, and the epilog from the root end tag on.
+namespace xml {
+struct record_layout {
+  // Just past the root start tag
+  std::size_t body_begin{0};
+  // At the root end tag
+  std::size_t body_end{0};
+  // Just past each child element of the root, in order. Record i starts
+  // where record i - 1 ends, with the text and comments in between.
+  std::vector<std::size_t> record_ends;
+  std::optional<parse_error> error;
+};
+
+// Finds the records of `document` with a depth tracking scan that only looks
+// at markup delimiters: comments, processing instructions, CDATA sections,
+// the doctype and quoted attribute values are skipped over, but names and
+// text are neither checked nor decoded.
+record_layout find_records(std::string_view document);
+
+// Offsets cutting the body into `count` runs of whole records of about the
+// same size: shard i covers [cuts[i], cuts[i + 1]). Fewer shards are made
+// when there aren't enough records.
+std::vector<std::size_t> cut_records(const record_layout &layout,
+                                     std::size_t count);
+
+// Writes shard i to fds[i], several shards at a time on `threads` threads.
+// False if any write fails.
+bool write_shards(std::string_view document, const record_layout &layout,
+                  std::span<const std::size_t> cuts, std::span<const int> fds,
+                  std::size_t threads = 0);
+} // namespace xml
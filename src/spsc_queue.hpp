@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <vector>
+
+// Bounded lock-free ring buffer between exactly one producer thread and one
+// consumer thread. The blocking operations spin briefly, then sleep on the
+// index the other side moves.
+template <class T> class spsc_queue {
+public:
+  // The capacity is rounded up to a power of two
+  explicit spsc_queue(std::size_t capacity)
+      : slots_(std::bit_ceil(capacity < 2 ? 2 : capacity)),
+        mask_{slots_.size() - 1} {}
+
+  spsc_queue(const spsc_queue &) = delete;
+  spsc_queue &operator=(const spsc_queue &) = delete;
+
+  // Producer side
+
+  bool try_push(T &value) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    tail_.notify_one();
+    return true;
+  }
+
+  void push(T value) {
+    for (int spins = 0; !try_push(value); ++spins) {
+      if (spins >= max_spins) {
+        auto head = head_.load(std::memory_order_acquire);
+        if (tail_.load(std::memory_order_relaxed) - head == slots_.size()) {
+          head_.wait(head, std::memory_order_acquire);
+        }
+      }
+    }
+  }
+
+  // No push may follow. The consumer still gets what is queued.
+  void close() {
+    tail_.fetch_or(closed_bit, std::memory_order_release);
+    tail_.notify_all();
+  }
+
+  // Consumer side
+
+  std::optional<T> try_pop() {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head == (tail_.load(std::memory_order_acquire) & ~closed_bit)) {
+      return std::nullopt;
+    }
+    std::optional<T> result{std::move(slots_[head & mask_])};
+    head_.store(head + 1, std::memory_order_release);
+    head_.notify_one();
+    return result;
+  }
+
+  // nullopt once the queue is closed and empty
+  std::optional<T> pop() {
+    for (int spins = 0;; ++spins) {
+      if (auto value = try_pop()) {
+        return value;
+      }
+      auto tail = tail_.load(std::memory_order_acquire);
+      if (tail & closed_bit) {
+        return try_pop();
+      }
+      if (spins >= max_spins &&
+          head_.load(std::memory_order_relaxed) == tail) {
+        tail_.wait(tail, std::memory_order_acquire);
+      }
+    }
+  }
+
+private:
+  constexpr static int max_spins = 64;
+  // kept in the tail so that closing wakes a sleeping consumer
+  constexpr static std::size_t closed_bit = std::size_t{1}
+                                            << (sizeof(std::size_t) * 8 - 1);
+
+  std::vector<T> slots_;
+  std::size_t mask_;
+  // next slot to read, only written by the consumer
+  alignas(64) std::atomic<std::size_t> head_{0};
+  // next slot to write, only written by the producer
+  alignas(64) std::atomic<std::size_t> tail_{0};
+};
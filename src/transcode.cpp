@@ -0,0 +1,273 @@
+#include "transcode.hpp"
+
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+constexpr std::string_view utf16be_bom{"\xFE\xFF", 2};
+constexpr std::string_view utf16le_bom{"\xFF\xFE", 2};
+constexpr std::string_view utf8_bom{"\xEF\xBB\xBF", 3};
+// "<?" without a byte order mark
+constexpr std::string_view utf16le_open{"<\0?\0", 4};
+constexpr std::string_view utf16be_open{"\0<\0?", 4};
+
+// The XML declaration is looked for this far at most
+constexpr std::size_t max_declaration = 1024;
+
+bool is_latin1(std::string_view name) noexcept {
+  constexpr std::string_view names[] = {"iso-8859-1", "iso8859-1", "iso_8859-1",
+                                        "latin1", "latin-1", "l1"};
+  return std::ranges::any_of(names, [&](std::string_view known) {
+    return std::ranges::equal(name, known, [](char a, char b) {
+      return std::tolower(static_cast<unsigned char>(a)) == b;
+    });
+  });
+}
+
+// The value of encoding="..." in the declaration, empty if there's none
+std::string_view declared_encoding(std::string_view declaration) noexcept {
+  auto key = declaration.find("encoding");
+  if (key == std::string_view::npos) {
+    return {};
+  }
+  auto rest = declaration.substr(key + 8);
+  auto skip_blanks = [&] {
+    while (!rest.empty() && std::isspace(static_cast<unsigned char>(rest[0]))) {
+      rest.remove_prefix(1);
+    }
+  };
+  skip_blanks();
+  if (!rest.starts_with('=')) {
+    return {};
+  }
+  rest.remove_prefix(1);
+  skip_blanks();
+  if (rest.empty() || (rest[0] != '"' && rest[0] != '\'')) {
+    return {};
+  }
+  auto end = rest.find(rest[0], 1);
+  return end == std::string_view::npos ? std::string_view{}
+                                       : rest.substr(1, end - 1);
+}
+
+void put_utf8(char *&out, std::uint32_t cp) noexcept {
+  if (cp < 0x80) {
+    *out++ = static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    *out++ = static_cast<char>(0xC0 | (cp >> 6));
+    *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    *out++ = static_cast<char>(0xE0 | (cp >> 12));
+    *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+  } else {
+    *out++ = static_cast<char>(0xF0 | (cp >> 18));
+    *out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+  }
+}
+
+constexpr std::uint32_t replacement = 0xFFFD;
+} // namespace
+
+std::optional<text_encoding> sniff_encoding(std::string_view head, bool at_end,
+                                            std::size_t &bom_size) noexcept {
+  bom_size = 0;
+  struct mark {
+    std::string_view bytes;
+    text_encoding encoding;
+    bool is_bom;
+  };
+  constexpr mark marks[] = {
+      {utf16be_bom, text_encoding::utf16be, true},
+      {utf16le_bom, text_encoding::utf16le, true},
+      {utf8_bom, text_encoding::utf8, true},
+      {utf16le_open, text_encoding::utf16le, false},
+      {utf16be_open, text_encoding::utf16be, false},
+  };
+  bool may_grow = false;
+  for (auto &m : marks) {
+    if (head.starts_with(m.bytes)) {
+      bom_size = m.is_bom ? m.bytes.size() : 0;
+      return m.encoding;
+    }
+    may_grow = may_grow || m.bytes.starts_with(head);
+  }
+
+  constexpr std::string_view xml_open = "<?xml";
+  if (head.starts_with(xml_open)) {
+    auto end = head.find("?>");
+    if (end == std::string_view::npos) {
+      if (!at_end && head.size() < max_declaration) {
+        return std::nullopt;
+      }
+      return text_encoding::utf8;
+    }
+    return is_latin1(declared_encoding(head.substr(0, end)))
+               ? text_encoding::latin1
+               : text_encoding::utf8;
+  }
+  may_grow = may_grow || xml_open.starts_with(head);
+  if (may_grow && !at_end) {
+    return std::nullopt;
+  }
+  return text_encoding::utf8;
+}
+
+std::string_view input_decoder::feed(std::string_view block) {
+  out_.clear();
+  if (!encoding_) {
+    return start_(block, false);
+  }
+  switch (*encoding_) {
+  case text_encoding::utf8:
+    return block;
+  case text_encoding::latin1:
+    decode_latin1_(block);
+    break;
+  default:
+    decode_utf16_(block);
+  }
+  return out_;
+}
+
+std::string_view input_decoder::finish() {
+  out_.clear();
+  if (!encoding_) {
+    start_({}, true);
+  }
+  // whatever is left of a character
+  for (int i = odd_byte_.has_value() + (high_surrogate_ != 0); i > 0; --i) {
+    out_.append("\xEF\xBF\xBD");
+  }
+  odd_byte_.reset();
+  high_surrogate_ = 0;
+  return out_;
+}
+
+std::string_view input_decoder::start_(std::string_view block, bool at_end) {
+  head_.append(block);
+  std::size_t bom_size;
+  encoding_ = sniff_encoding(head_, at_end, bom_size);
+  if (!encoding_) {
+    return {};
+  }
+  std::string_view held{head_};
+  held.remove_prefix(bom_size);
+  switch (*encoding_) {
+  case text_encoding::utf8:
+    out_.append(held);
+    break;
+  case text_encoding::latin1:
+    decode_latin1_(held);
+    break;
+  default:
+    decode_utf16_(held);
+  }
+  head_ = {};
+  return out_;
+}
+
+void input_decoder::put_unit_(char *&out, std::uint16_t unit) noexcept {
+  if (high_surrogate_ != 0) {
+    if (unit >= 0xDC00 && unit <= 0xDFFF) {
+      auto high = std::uint32_t{high_surrogate_} - 0xD800;
+      put_utf8(out, 0x10000 + (high << 10) + (unit - 0xDC00u));
+      high_surrogate_ = 0;
+      return;
+    }
+    high_surrogate_ = 0;
+    put_utf8(out, replacement);
+  }
+  if (unit >= 0xD800 && unit <= 0xDBFF) {
+    high_surrogate_ = unit;
+  } else if (unit >= 0xDC00 && unit <= 0xDFFF) {
+    put_utf8(out, replacement);
+  } else {
+    put_utf8(out, unit);
+  }
+}
+
+void input_decoder::decode_utf16_(std::string_view block) {
+  bool big_endian = *encoding_ == text_encoding::utf16be;
+  auto unit_at = [&](const unsigned char *p) {
+    return static_cast<std::uint16_t>(big_endian ? (p[0] << 8) | p[1]
+                                                 : p[0] | (p[1] << 8));
+  };
+  auto old = out_.size();
+  // 3 bytes per unit at most, the carried over ones included
+  auto capacity = old + (block.size() / 2 + 3) * 3;
+  out_.resize_and_overwrite(capacity, [&](char *buf, std::size_t) {
+    auto out = buf + old;
+    auto data = reinterpret_cast<const unsigned char *>(block.data());
+    auto size = block.size();
+    std::size_t i = 0;
+    if (odd_byte_ && size != 0) {
+      unsigned char unit[2] = {*odd_byte_, data[0]};
+      odd_byte_.reset();
+      put_unit_(out, unit_at(unit));
+      i = 1;
+    }
+#if defined(__SSE2__)
+    auto not_ascii = _mm_set1_epi16(static_cast<short>(0xFF80));
+    auto zero = _mm_setzero_si128();
+    while (i + simd::width <= size) {
+      auto units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      if (big_endian) {
+        units =
+            _mm_or_si128(_mm_slli_epi16(units, 8), _mm_srli_epi16(units, 8));
+      }
+      auto ascii = _mm_cmpeq_epi16(_mm_and_si128(units, not_ascii), zero);
+      if (high_surrogate_ == 0 && _mm_movemask_epi8(ascii) == 0xFFFF) {
+        // 8 units down to 8 bytes
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out),
+                         _mm_packus_epi16(units, units));
+        out += 8;
+        i += simd::width;
+        continue;
+      }
+      for (auto end = i + simd::width; i < end; i += 2) {
+        put_unit_(out, unit_at(data + i));
+      }
+    }
+#endif
+    for (; i + 2 <= size; i += 2) {
+      put_unit_(out, unit_at(data + i));
+    }
+    if (i < size) {
+      odd_byte_ = data[i];
+    }
+    return static_cast<std::size_t>(out - buf);
+  });
+}
+
+void input_decoder::decode_latin1_(std::string_view block) {
+  auto old = out_.size();
+  out_.resize_and_overwrite(old + 2 * block.size(), [&](char *buf,
+                                                        std::size_t) {
+    auto out = buf + old;
+    auto data = reinterpret_cast<const unsigned char *>(block.data());
+    auto size = block.size();
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + simd::width <= size; i += simd::width) {
+      auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      if (_mm_movemask_epi8(bytes) == 0) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), bytes);
+        out += simd::width;
+        continue;
+      }
+      for (std::size_t k = 0; k < simd::width; ++k) {
+        put_utf8(out, data[i + k]);
+      }
+    }
+#endif
+    for (; i < size; ++i) {
+      put_utf8(out, data[i]);
+    }
+    return static_cast<std::size_t>(out - buf);
+  });
+}
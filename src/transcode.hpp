@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+enum class text_encoding : std::uint8_t { utf8, utf16le, utf16be, latin1 };
+
+// Encoding of a document from its first bytes: a byte order mark, "<?xml"
+// written in UTF-16, or the encoding named by the XML declaration, UTF-8
+// when there's none of those. nullopt while `head` is too short to tell,
+// unless `at_end` says no more is coming. `bom_size` is set to the length
+// of the byte order mark, if any.
+std::optional<text_encoding> sniff_encoding(std::string_view head, bool at_end,
+                                            std::size_t &bom_size) noexcept;
+
+// Turns input in whatever encoding sniff_encoding finds into UTF-8, a block
+// at a time. The first bytes are held back until the encoding is known,
+// and byte order marks are dropped. UTF-8 input goes through untouched;
+// runs of ASCII in the others are converted 16 bytes at a time. Unpaired
+// surrogates and a dangling UTF-16 byte become U+FFFD.
+class input_decoder {
+public:
+  // The UTF-8 for `block`. It views either the block itself or a buffer of
+  // the decoder, valid until the next call.
+  std::string_view feed(std::string_view block);
+  // What's still held once the input is over
+  std::string_view finish();
+
+  std::optional<text_encoding> encoding() const noexcept { return encoding_; }
+
+private:
+  std::string_view start_(std::string_view block, bool at_end);
+  void decode_utf16_(std::string_view block);
+  void decode_latin1_(std::string_view block);
+  void put_unit_(char *&out, std::uint16_t unit) noexcept;
+
+  std::optional<text_encoding> encoding_;
+  // input held while sniffing
+  std::string head_;
+  std::string out_;
+  // a UTF-16 code unit split across blocks, and a high surrogate waiting
+  // for its pair
+  std::optional<unsigned char> odd_byte_;
+  std::uint16_t high_surrogate_{0};
+};
@@ -0,0 +1,87 @@
+#include "utf8.hpp"
+
+#include "simd.hpp"
+
+std::size_t utf8_validator::feed(std::string_view block) noexcept {
+  auto data = reinterpret_cast<const unsigned char *>(block.data());
+  auto size = block.size();
+  auto base = fed_;
+  fed_ += size;
+
+  std::size_t i = 0;
+  while (i < size) {
+    if (needed_ == 0) {
+      // ASCII needs no state, skip over it in bulk
+#if defined(__SSE2__)
+      while (i + simd::width <= size) {
+        auto block16 =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        auto high = static_cast<unsigned>(_mm_movemask_epi8(block16));
+        if (high != 0) {
+          i += static_cast<std::size_t>(__builtin_ctz(high));
+          break;
+        }
+        i += simd::width;
+      }
+#endif
+      while (i < size && data[i] < 0x80) {
+        i++;
+      }
+      if (i == size) {
+        break;
+      }
+
+      auto lead = data[i];
+      sequence_start_ = base + i;
+      lower_ = 0x80;
+      upper_ = 0xBF;
+      if (lead >= 0xC2 && lead <= 0xDF) {
+        needed_ = 1;
+      } else if (lead >= 0xE0 && lead <= 0xEF) {
+        needed_ = 2;
+        // no overlong forms, no surrogates
+        if (lead == 0xE0) {
+          lower_ = 0xA0;
+        } else if (lead == 0xED) {
+          upper_ = 0x9F;
+        }
+      } else if (lead >= 0xF0 && lead <= 0xF4) {
+        needed_ = 3;
+        // no overlong forms, nothing past U+10FFFF
+        if (lead == 0xF0) {
+          lower_ = 0x90;
+        } else if (lead == 0xF4) {
+          upper_ = 0x8F;
+        }
+      } else {
+        return sequence_start_;
+      }
+      // the whole character is here, check it at once
+      if (i + needed_ < size) {
+        if (data[i + 1] < lower_ || data[i + 1] > upper_) {
+          return sequence_start_;
+        }
+        for (std::size_t k = 2; k <= needed_; ++k) {
+          if ((data[i + k] & 0xC0) != 0x80) {
+            return sequence_start_;
+          }
+        }
+        i += needed_ + 1u;
+        needed_ = 0;
+        continue;
+      }
+      i++;
+      continue;
+    }
+
+    auto c = data[i];
+    if (c < lower_ || c > upper_) {
+      return sequence_start_;
+    }
+    lower_ = 0x80;
+    upper_ = 0xBF;
+    needed_--;
+    i++;
+  }
+  return npos;
+}
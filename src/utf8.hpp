@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Checks that input is well-formed UTF-8, a block at a time as it arrives:
+// no overlong forms, surrogates or code points past U+10FFFF. Characters
+// may be split across blocks. Runs of ASCII are skipped 16 bytes at a time.
+class utf8_validator {
+public:
+  constexpr static std::size_t npos = std::string::npos;
+
+  // `first` is the position of the first byte to be fed, positions returned
+  // count from there
+  explicit utf8_validator(std::size_t first = 0) noexcept : fed_{first} {}
+
+  // Position of the first byte of the first invalid sequence in `block`, or
+  // in what came before it if the block doesn't complete a character
+  // properly; npos if all is fine so far. Nothing more should be fed after
+  // an error.
+  std::size_t feed(std::string_view block) noexcept;
+
+  // Where the last character starts if the input stops in the middle of
+  // it, npos otherwise
+  std::size_t finish() const noexcept {
+    return needed_ == 0 ? npos : sequence_start_;
+  }
+
+private:
+  std::size_t fed_;
+  std::size_t sequence_start_{0};
+  // continuation bytes still expected, and the range of the next one
+  std::uint8_t needed_{0};
+  std::uint8_t lower_{0x80};
+  std::uint8_t upper_{0xBF};
+};
+
+// Position of the first invalid sequence of `text`, npos if it's all UTF-8
+inline std::size_t find_invalid_utf8(std::string_view text) noexcept {
+  utf8_validator validator;
+  auto bad = validator.feed(text);
+  return bad != utf8_validator::npos ? bad : validator.finish();
+}
@@ -0,0 +1,165 @@
+#include "writer.hpp"
+
+#include "simd.hpp"
+
+namespace xml {
+
+void writer::open(std::string_view name) {
+  end_start_tag_();
+  new_line_();
+  out_.put('<');
+  out_.write(name);
+  start_tag_open_ = true;
+  had_child_ = false;
+  depth_++;
+}
+
+void writer::attribute(std::string_view key, std::string_view value) {
+  out_.put(' ');
+  out_.write(key);
+  out_.write("=\"");
+  escaped_(value);
+  out_.put('"');
+}
+
+void writer::text(std::string_view content) {
+  if (options_.pretty) {
+    auto first = content.find_first_not_of(" \t\n\r");
+    if (first == std::string_view::npos) {
+      return;
+    }
+    content = content.substr(
+        first, content.find_last_not_of(" \t\n\r") - first + 1);
+  }
+  if (!options_.escape &&
+      simd::find_any<'<'>(content.data(), content.size()) != content.size()) {
+    cdata(content);
+    return;
+  }
+  end_start_tag_();
+  escaped_(content);
+}
+
+void writer::cdata(std::string_view content) {
+  end_start_tag_();
+  out_.write("<![CDATA[");
+  for (auto end = content.find("]]>"); end != std::string_view::npos;
+       end = content.find("]]>")) {
+    // "]]" ends this section, and '>' starts the next one
+    out_.write(content.substr(0, end + 2));
+    out_.write("]]><![CDATA[");
+    content.remove_prefix(end + 2);
+  }
+  out_.write(content);
+  out_.write("]]>");
+}
+
+void writer::close(std::string_view name) {
+  if (start_tag_open_) {
+    self_close();
+    return;
+  }
+  depth_--;
+  if (had_child_) {
+    new_line_();
+  }
+  out_.write("</");
+  out_.write(name);
+  out_.put('>');
+  had_child_ = true;
+}
+
+void writer::self_close() {
+  depth_--;
+  out_.write("/>");
+  start_tag_open_ = false;
+  had_child_ = true;
+}
+
+void writer::comment(std::string_view content) {
+  end_start_tag_();
+  new_line_();
+  out_.write("<!--");
+  out_.write(content);
+  out_.write("-->");
+  had_child_ = true;
+}
+
+void writer::processing_instruction(std::string_view name) {
+  end_start_tag_();
+  new_line_();
+  out_.write("<?");
+  out_.write(name);
+}
+
+void writer::processing_instruction_end() {
+  out_.write("?>");
+  had_child_ = true;
+}
+
+void writer::write(const tag &xml) {
+  if (xml.name.empty()) {
+    for (auto &child : xml.children) {
+      write(child);
+    }
+    return;
+  }
+  open(xml.name);
+  for (auto &attr : xml.attributes) {
+    attribute(attr.name, attr.value);
+  }
+  if (!xml.content.empty()) {
+    text(xml.content);
+  }
+  for (auto &child : xml.children) {
+    write(child);
+  }
+  close(xml.name);
+}
+
+void writer::end_start_tag_() {
+  if (start_tag_open_) {
+    out_.put('>');
+    start_tag_open_ = false;
+  }
+}
+
+void writer::new_line_() {
+  if (at_start_) {
+    at_start_ = false;
+    return;
+  }
+  if (options_.pretty) {
+    out_.put('\n');
+    for (auto n = depth_ * options_.indent; n > 0; --n) {
+      out_.put(' ');
+    }
+  }
+}
+
+void writer::escaped_(std::string_view content) {
+  if (!options_.escape) {
+    out_.write(content);
+    return;
+  }
+  while (!content.empty()) {
+    auto pos = simd::find_any<'<', '&', '"'>(content.data(), content.size());
+    out_.write(content.substr(0, pos));
+    if (pos == content.size()) {
+      break;
+    }
+    switch (content[pos]) {
+    case '<':
+      out_.write("&lt;");
+      break;
+    case '&':
+      out_.write("&amp;");
+      break;
+    default:
+      out_.write("&quot;");
+      break;
+    }
+    content.remove_prefix(pos + 1);
+  }
+}
+} // namespace xml
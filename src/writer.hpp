@@ -0,0 +1,78 @@
+#pragma once
+
+#include "buffered_writer.hpp"
+#include "xml.hpp"
+
+#include <cstddef>
+#include <string_view>
+
+namespace xml {
+struct write_options {
+  // Break lines and indent nested elements
+  bool pretty{false};
+  std::size_t indent{2};
+  // Escape '<', '&' and '"' in text and attribute values. The parsers don't
+  // expand entities, so turn it off to re-emit parsed documents verbatim.
+  // Unescaped text with a '<' can only have come from a CDATA section, and
+  // is written back as one.
+  bool escape{true};
+};
+
+// Serializes elements to a buffered_writer, either piece by piece, from a
+// DOM, or by replaying parser events
+class writer {
+public:
+  explicit writer(buffered_writer &out, write_options options = {}) noexcept
+      : out_{out}, options_{options} {}
+
+  void open(std::string_view name);
+  void attribute(std::string_view key, std::string_view value);
+  void text(std::string_view content);
+  // Split in two around every "]]>", which would end it
+  void cdata(std::string_view content);
+  // Elements without content are written as self-closing tags
+  void close(std::string_view name);
+  void self_close();
+  void comment(std::string_view content);
+  void processing_instruction(std::string_view name);
+  void processing_instruction_end();
+
+  // A nameless tag, like the root returned by build_xml_doc, only writes its
+  // children
+  void write(const tag &xml);
+
+  void operator()(const tag_open &ev) { open(ev.name); }
+  void operator()(const tag_close &ev) { close(ev.name); }
+  void operator()(const tag_self_close &) { self_close(); }
+  void operator()(const tag_attribute &ev) { attribute(ev.key, ev.value); }
+  void operator()(const tag_content &ev) {
+    ev.cdata ? cdata(ev.content) : text(ev.content);
+  }
+  void operator()(const xml::comment &ev) { comment(ev.comment); }
+  void operator()(const processing_instruction_begin &ev) {
+    processing_instruction(ev.name);
+  }
+  void operator()(const xml::processing_instruction_end &) {
+    processing_instruction_end();
+  }
+  // Recover mode drops the markup an error broke off, so what is written
+  // can't be the document that was parsed: the output is marked as failed
+  void operator()(const parse_error &) { failed_ = true; }
+
+  // False if writing failed or a parse_error was replayed
+  bool flush() noexcept { return out_.flush() && !failed_; }
+
+private:
+  void end_start_tag_();
+  void new_line_();
+  void escaped_(std::string_view content);
+
+  buffered_writer &out_;
+  write_options options_;
+  std::size_t depth_{0};
+  bool at_start_{true};
+  bool start_tag_open_{false};
+  bool had_child_{false};
+  bool failed_{false};
+};
+} // namespace xml
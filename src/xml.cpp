@@ -22,6 +22,13 @@ namespace xml {
 
 #define advance_to(...) fail_if(!stream.seek(__VA_ARGS__))
 
+// Failures the caller has to be told about, through the context
+#define fail_because(cond, reason)                                             \
+  if ((cond)) {                                                                \
+    ctx.error = parse_error{stream.cursor(), reason};                          \
+    return std::nullopt;                                                       \
+  }
+
 std::optional<std::string_view> next_string_or_word(char_stream &stream) {
   advance_to(std::not_fn(isspace));
 
@@ -34,31 +41,76 @@ std::optional<std::string_view> next_string_or_word(char_stream &stream) {
   return std::nullopt;
 }
 
-namespace tree {
-template <size_t S>
-size_t tag_end(char_stream &stream, const char (&pattern)[S]) {
-  const char *current = pattern;
-  auto beg = stream.cursor();
-  size_t result = std::string::npos;
-
-  while (stream) {
-    auto c = stream.read_char();
+void append_collapsed(std::string &out, std::string_view text) {
+  if (text.empty()) {
+    return;
+  }
+  // most runs only have single spaces between words
+  if (text.front() != ' ' && text.back() != ' ' &&
+      text.find_first_of("\t\n\v\f\r") == std::string_view::npos &&
+      text.find("  ") == std::string_view::npos) {
+    out += text;
+    return;
+  }
 
-    break_if(c == '"' && !stream.seek(xml_string_end(stream)));
+  out.reserve(out.size() + text.size());
+  while (!text.empty()) {
+    auto space = find_space(text);
+    out += text.substr(0, space);
+    text.remove_prefix(space);
+    text.remove_prefix(find_non_space(text));
+    if (!text.empty()) {
+      out += ' ';
+    }
+  }
+}
 
-    if (c == *current) {
-      current++;
-      if (current == pattern + S - 1) {
-        result = stream.cursor() + 1;
-        break;
+namespace syntax {
+size_t declaration_end(char_stream &stream) {
+  constexpr auto npos = std::string::npos;
+  auto start = stream.cursor();
+  DEFER { stream.seek(start); };
+
+  std::size_t brackets = 0;
+  for (auto pos = start;;) {
+    pos = stream.find_any<'>', '"', '\'', '[', ']', '<'>(pos);
+    if (pos == npos) {
+      return npos;
+    }
+    auto c = stream.substring(pos, 1).front();
+    if (c == '"' || c == '\'') {
+      pos = c == '"' ? stream.find_any<'"'>(pos + 1)
+                     : stream.find_any<'\''>(pos + 1);
+      if (pos == npos) {
+        return npos;
       }
-    } else {
-      current = pattern;
+    } else if (c == '[') {
+      brackets++;
+    } else if (c == ']') {
+      brackets -= brackets != 0;
+    } else if (c == '<') {
+      // declarations of the subset are only looked into for comments
+      if (stream.substring(pos, 4) == "<!--") {
+        stream.seek(pos + 4);
+        pos = syntax::find_seq(stream, "-->");
+        if (pos == npos) {
+          return npos;
+        }
+        pos += 2;
+      }
+    } else if (brackets == 0) {
+      return pos + 1;
     }
+    pos++;
   }
+}
+} // namespace syntax
 
-  stream.seek(beg);
-  return result;
+namespace tree {
+// Just past the first `terminator` from the cursor on
+size_t end_of(char_stream &stream, std::string_view terminator) {
+  auto pos = stream.find(terminator);
+  return pos == std::string::npos ? pos : pos + terminator.size();
 }
 
 struct opening_tag {
@@ -66,7 +118,8 @@ struct opening_tag {
   bool self_closing;
 };
 
-std::optional<opening_tag> parse_attributes(char_stream &stream) {
+std::optional<opening_tag> parse_attributes(char_stream &stream,
+                                            context &ctx) {
   std::vector<xml::attribute> attrs;
   while (stream) {
     auto c = stream.peek();
@@ -88,10 +141,17 @@ std::optional<opening_tag> parse_attributes(char_stream &stream) {
     }
 
     if (xml_tag_head(c)) {
+      fail_because(attrs.size() == ctx.limits.max_attributes,
+                   "too many attributes");
+      auto name_end = xml_word_end(stream);
+      fail_because(name_end != std::string::npos &&
+                       name_end - stream.cursor() > ctx.limits.max_name_length,
+                   "name too long");
       syntax::parse_to(stream, xml_word_end)
-          .transform([&attrs](std::string_view attr_name_end) {
+          .transform([&](std::string_view attr_name_end) {
             attrs.emplace_back(xml::attribute{
                 .name = std::string{attr_name_end},
+                .id = syntax::resolve_name(ctx, attr_name_end),
                 .value = "",
             });
             return 0;
@@ -101,6 +161,10 @@ std::optional<opening_tag> parse_attributes(char_stream &stream) {
       stream.advance();
       auto attr_value = next_string_or_word(stream);
       fail_if(!attr_value.has_value());
+      if (attr_value->starts_with('"')) {
+        // strings are returned with their quotes
+        attr_value = attr_value->substr(1, attr_value->size() - 2);
+      }
       attrs.back().value = std::string{attr_value.value()};
     } else {
       stream.advance();
@@ -109,26 +173,39 @@ std::optional<opening_tag> parse_attributes(char_stream &stream) {
   return std::nullopt;
 }
 
-std::optional<xml::tag> parse_current_tag_body(char_stream &stream, xml::tag);
-std::optional<xml::tag> parse_tag(char_stream &stream) {
+std::optional<xml::tag> parse_current_tag_body(char_stream &stream,
+                                               context &ctx, xml::tag);
+std::optional<xml::tag> parse_tag(char_stream &stream, context &ctx) {
+  fail_because(ctx.depth == ctx.limits.max_depth, "nesting too deep");
+  fail_because(ctx.nodes == ctx.limits.max_nodes, "too many elements");
+  ctx.nodes++;
+  ctx.depth++;
+  DEFER { ctx.depth--; };
+
   return next_xml_word(stream).and_then(
       [&](std::string_view name) -> std::optional<xml::tag> {
-        return parse_attributes(stream).and_then(
+        fail_because(name.size() > ctx.limits.max_name_length,
+                     "name too long");
+        xml::tag xml{
+            .name = std::string{name},
+            .id = syntax::resolve_name(ctx, name),
+            .attributes = {},
+            .children = {},
+            .content = {},
+        };
+        return parse_attributes(stream, ctx).and_then(
             [&](opening_tag attrs) -> std::optional<xml::tag> {
-              xml::tag xml{
-                  .name = std::string{name},
-                  .attributes = std::move(attrs).attributes,
-              };
+              xml.attributes = std::move(attrs).attributes;
               if (attrs.self_closing) {
                 return std::move(xml);
               } else {
-                return parse_current_tag_body(stream, std::move(xml));
+                return parse_current_tag_body(stream, ctx, std::move(xml));
               }
             });
       });
 }
 
-std::optional<xml::tag> next_tag(char_stream &stream) {
+std::optional<xml::tag> next_tag(char_stream &stream, context &ctx) {
 
   while (stream) {
     advance_to(char_eq('<'));
@@ -138,7 +215,7 @@ std::optional<xml::tag> next_tag(char_stream &stream) {
     switch (stream.peek()) {
 
     case '?': {
-      advance_to(tag_end(stream, "?>"));
+      advance_to(end_of(stream, "?>"));
       break;
     }
 
@@ -146,10 +223,10 @@ std::optional<xml::tag> next_tag(char_stream &stream) {
       stream.advance();
       if (stream.peek() != '-') {
         fail_if(next_xml_word(stream) != "DOCTYPE");
-        advance_to(tag_end(stream, ">"));
+        advance_to(syntax::declaration_end(stream));
       } else {
         stream.advance();
-        advance_to(tag_end(stream, "-->"));
+        advance_to(end_of(stream, "-->"));
       }
       break;
     }
@@ -160,57 +237,107 @@ std::optional<xml::tag> next_tag(char_stream &stream) {
   }
 loop_exit:
 
-  return parse_tag(stream);
+  return parse_tag(stream, ctx);
 }
 
 // Parse the body of a tag (content and children). The attributes must have
 // already been processed
 std::optional<xml::tag> parse_current_tag_body(char_stream &stream,
-                                               xml::tag tag) {
-  int buffered_space = 0;
-  advance_to(std::not_fn(isspace));
+                                               context &ctx, xml::tag tag) {
+  if (!ctx.raw_text) {
+    advance_to(std::not_fn(isspace));
+  }
   while (stream) {
-    char c = stream.peek();
-    if (c == '<') {
-      stream.advance();
-      advance_to(std::not_fn(isspace));
+    // the whole text run up to the next tag at once
+    auto open = stream.find('<');
+    fail_if(open == std::string::npos);
+    auto text = stream.consume_to(open);
+    if (ctx.raw_text) {
+      tag.content += text;
+    } else {
+      append_collapsed(tag.content, text);
+    }
 
-      if (stream.peek() == '/') {
-        stream.advance();
-        auto word = next_xml_word(stream);
-        fail_if(!word || word != tag.name);
-        advance_to(std::not_fn(isspace));
-        fail_if(!stream || stream.read_char() != '>');
-        return std::move(tag);
-      } else if (stream.peek() == '!') {
-        stream.advance();
-        fail_if(stream.read_char() != '-');
-        fail_if(stream.read_char() != '-');
-        advance_to(tag_end(stream, "-->"));
+    stream.advance();
+    advance_to(std::not_fn(isspace));
+
+    if (stream.peek() == '/') {
+      stream.advance();
+      auto word = next_xml_word(stream);
+      // with interned names the end tag's id is found in the table, and the
+      // compare is then of two integers
+      fail_if(!word);
+      if (tag.id != no_name) {
+        fail_because(ctx.names->find(*word) != tag.id,
+                     "mismatched closing tag");
       } else {
-        auto xml = parse_tag(stream);
-        fail_if(!xml.has_value());
-        tag.children.emplace_back(std::move(xml).value());
+        fail_because(*word != tag.name, "mismatched closing tag");
       }
-      buffered_space = 0;
-    } else if (isspace(c)) {
-      buffered_space++;
+      advance_to(std::not_fn(isspace));
+      fail_if(!stream || stream.read_char() != '>');
+      return tag;
+    } else if (stream.peek() == '!') {
       stream.advance();
-    } else {
-      if (buffered_space != 0) {
-        tag.content += ' ';
-        buffered_space = 0;
+      if (stream.peek() == '[') {
+        fail_if(stream.consume(7) != "[CDATA[");
+        auto end = stream.find("]]>");
+        fail_if(end == std::string::npos);
+        // kept as is, even when other text is collapsed
+        tag.content += stream.consume_to(end);
+        stream.advance(3);
+        continue;
       }
-      tag.content += stream.read_char();
+      fail_if(stream.read_char() != '-');
+      fail_if(stream.read_char() != '-');
+      advance_to(end_of(stream, "-->"));
+    } else {
+      auto xml = parse_tag(stream, ctx);
+      fail_if(!xml.has_value());
+      tag.children.emplace_back(std::move(xml).value());
     }
   }
   return std::nullopt;
 }
 
 } // namespace tree
+
+void resolve_namespaces(tag &root, context &ctx) {
+  constexpr config defaults{};
+  // the nameless root returned by build_xml_doc isn't an element
+  bool is_element = !root.name.empty();
+  if (is_element) {
+    ctx.namespaces.open();
+    for (auto &attr : root.attributes) {
+      if (attr.name == "xmlns" || attr.name.starts_with("xmlns:")) {
+        auto prefix = attr.name == "xmlns" ? std::string_view{}
+                                           : local_name(attr.name);
+        ctx.namespaces.declare(
+            prefix, attr.value.empty()
+                        ? no_name
+                        : syntax::resolve_uri<defaults>(ctx, attr.value));
+      }
+    }
+    root.ns = syntax::resolve_namespace<defaults>(ctx, root.name, false);
+    for (auto &attr : root.attributes) {
+      attr.ns = syntax::resolve_namespace<defaults>(ctx, attr.name, true);
+    }
+  }
+  for (auto &child : root.children) {
+    resolve_namespaces(child, ctx);
+  }
+  if (is_element) {
+    ctx.namespaces.close();
+  }
+}
 } // namespace xml
 
 std::optional<xml::tag> build_xml_doc(char_stream &stream) {
+  xml::context ctx;
+  return build_xml_doc(stream, ctx);
+}
+
+std::optional<xml::tag> build_xml_doc(char_stream &stream, xml::context &ctx) {
+  ctx.start(stream);
   xml::tag root{};
   std::vector<xml::tag> tags;
   xml::tag *current_tag = &root;
@@ -218,12 +345,19 @@ std::optional<xml::tag> build_xml_doc(char_stream &stream) {
   tag_stack.push(current_tag);
 
   while (stream) {
-    if (auto maybe_tag = xml::tree::next_tag(stream); maybe_tag.has_value()) {
+    if (auto maybe_tag = xml::tree::next_tag(stream, ctx);
+        maybe_tag.has_value()) {
       root.children.emplace_back(std::move(maybe_tag).value());
     } else {
       break;
     }
   }
+  if ((stream.overflowed() || stream.malformed()) && !ctx.error) {
+    ctx.error = xml::stream_error(stream, {});
+  }
+  if (ctx.error) {
+    return std::nullopt;
+  }
   return root;
 }
 
@@ -3,7 +3,13 @@
 #include "parsers.hpp"
 
 #include "char_stream.hpp"
+#include "element_stack.hpp"
+#include "frame_pool.hpp"
+#include "name_table.hpp"
+#include "namespaces.hpp"
+#include "simd.hpp"
 
+#include <cstdint>
 #include <functional>
 #include <optional>
 #include <string>
@@ -12,14 +18,19 @@
 namespace xml {
 struct attribute {
   std::string name;
+  name_id id{no_name};
   std::string value;
+  // Set by resolve_namespaces
+  name_id ns{no_name};
 };
 
 struct tag {
   std::string name;
+  name_id id{no_name};
   std::vector<attribute> attributes;
   std::vector<tag> children;
   std::string content;
+  name_id ns{no_name};
 };
 
 inline bool xml_tag_head(char c) { return isalpha(c) || c == '_'; }
@@ -43,28 +54,133 @@ inline std::optional<std::string_view> next_xml_word(char_stream &stream) {
 }
 
 std::optional<std::string_view> next_string_or_word(char_stream &stream);
+
+// Same blanks as isspace in the C locale
+inline std::size_t find_space(std::string_view text) noexcept {
+  return simd::find_any<' ', '\t', '\n', '\v', '\f', '\r'>(text.data(),
+                                                         text.size());
+}
+inline std::size_t find_non_space(std::string_view text) noexcept {
+  return simd::find_none<' ', '\t', '\n', '\v', '\f', '\r'>(text.data(),
+                                                          text.size());
+}
+inline bool is_blank(std::string_view text) noexcept {
+  return find_non_space(text) == text.size();
+}
+
+// Appends `text` with every run of blanks turned into a single space, and
+// without the trailing one
+void append_collapsed(std::string &out, std::string_view text);
+
+// Where and why a parse failed
+struct parse_error {
+  // Position in the stream, in char_stream::cursor() units
+  std::size_t offset;
+  std::string_view reason;
+};
+
+// The error for a step that failed at the cursor for `reason`, unless the
+// stream stopped short under it
+inline parse_error stream_error(const char_stream &stream,
+                                std::string_view reason) noexcept {
+  if (stream.overflowed()) {
+    return {stream.cursor(), "buffer limit exceeded"};
+  }
+  if (stream.malformed()) {
+    return {stream.buffered_end(), "invalid UTF-8"};
+  }
+  return {stream.cursor(), reason};
+}
+
+// Bounds on what a single parse may use, for input that isn't trusted.
+// Going over one fails the parse with an error in context::error.
+struct parse_limits {
+  constexpr static std::size_t unlimited = std::size_t(-1);
+
+  // What the parse reads stays buffered until char_stream::discard_consumed
+  std::size_t max_buffered_bytes{unlimited};
+  // The tree builder recurses once per level, so unlike the others this one
+  // is on by default: trusted documents nested deeper than 1024 elements
+  // need it raised, or set to unlimited
+  std::size_t max_depth{1024};
+  std::size_t max_attributes{unlimited};
+  std::size_t max_name_length{unlimited};
+  // Elements in the whole document
+  std::size_t max_nodes{unlimited};
+};
+
+// Runtime state shared by every step of a single parse
+struct context {
+  // When set, names are interned and events and nodes carry their id
+  name_table *names{nullptr};
+  namespace_scopes namespaces;
+  // Of the event parser and sax_parse, to match end tags
+  element_stack elements;
+  // build_xml_doc keeps text content as written instead of collapsing its
+  // whitespace
+  bool raw_text{false};
+  // Set when the event parser fails. With error_handling::recover it only
+  // holds the error being reported.
+  std::optional<parse_error> error;
+  // Set once a step failed because the stream stopped short, so that the
+  // end of the parse doesn't report that again
+  bool stream_stopped{false};
+
+  parse_limits limits;
+  // Current nesting and elements seen so far
+  std::size_t depth{0};
+  std::size_t nodes{0};
+
+  // Clears what's left of a previous parse and applies the limits
+  void start(char_stream &stream) {
+    error.reset();
+    stream_stopped = false;
+    depth = 0;
+    nodes = 0;
+    namespaces.reset();
+    elements.reset();
+    stream.limit_buffer(limits.max_buffered_bytes);
+  }
+};
+
+// Sets the namespace of every element and prefixed attribute of a tree
+void resolve_namespaces(tag &root, context &ctx);
 } // namespace xml
 
 std::optional<xml::tag> build_xml_doc(char_stream &stream);
+std::optional<xml::tag> build_xml_doc(char_stream &stream, xml::context &ctx);
 
 #include <variant>
 #include <cassert>
 #include <coroutine>
 
 namespace xml {
+// With config::process_namespaces, `ns` and `local` hold the resolved
+// namespace and the name without its prefix
 struct tag_open {
   std::string_view name;
+  name_id id{no_name};
+  name_id ns{no_name};
+  std::string_view local{};
 };
 struct tag_close {
   std::string_view name;
+  name_id id{no_name};
+  name_id ns{no_name};
+  std::string_view local{};
 };
 struct tag_self_close {};
 struct tag_attribute {
   std::string_view key;
   std::string_view value;
+  name_id id{no_name};
+  name_id ns{no_name};
+  std::string_view local{};
 };
 struct tag_content {
   std::string_view content;
+  // From a CDATA section, where '<' and '&' are only text
+  bool cdata{false};
 };
 
 struct comment {
@@ -81,6 +197,29 @@ struct processing_instruction_begin {
 
 struct processing_instruction_end {};
 
+// Stream offset of an event: where its name or text starts, or for events
+// that have neither, where the parser stood when emitting it. Events only
+// refer to the stream, so this must be called while handling the event.
+inline std::size_t event_offset(const char_stream &stream,
+                                const auto &event) noexcept {
+  if constexpr (requires { event.name; }) {
+    return stream.offset_of(event.name);
+  } else if constexpr (requires { event.key; }) {
+    return stream.offset_of(event.key);
+  } else if constexpr (requires { event.content; }) {
+    return stream.offset_of(event.content);
+  } else if constexpr (requires { event.comment; }) {
+    return stream.offset_of(event.comment);
+  } else if constexpr (requires { event.offset; }) {
+    return event.offset;
+  } else if constexpr (requires { event.valueless_by_exception(); }) {
+    return std::visit(
+        [&](const auto &e) { return event_offset(stream, e); }, event);
+  } else {
+    return stream.cursor();
+  }
+}
+
 struct config {
   bool emit_tag_open{true};
   bool emit_tag_close{true};
@@ -91,12 +230,44 @@ struct config {
   bool emit_processing_instruction_end{true};
   bool emit_comments{false};
 
-  enum class error_handling { stop };
+  // Compile-time name recognition, e.g. &schema<"a", "b">::recognizer. Known
+  // names get their id from it, the others fall back to the name_table.
+  const name_recognizer *recognize_names{nullptr};
+
+  // Track xmlns declarations and resolve the namespace of every name
+  bool process_namespaces{false};
+
+  // Fail on input that isn't well-formed UTF-8, checked as it is read, see
+  // char_stream::check_utf8
+  bool validate_utf8{false};
+
+  // Read UTF-16 and ISO-8859-1 input as UTF-8, see char_stream::decode_input
+  bool decode_input{false};
+
+  // stop ends the parse on the first error, leaving it in context::error.
+  // recover emits a parse_error event instead, skips to the next '<' and
+  // carries on from the innermost element still open. An end tag that
+  // doesn't match that element is reported too: it closes the one it names
+  // and everything inside, or nothing if no open element has its name.
+  enum class error_handling { stop, recover };
   error_handling on_error{error_handling::stop};
 };
 
+constexpr bool recovers_from_errors(const config &c) {
+  return c.on_error == config::error_handling::recover;
+}
+
 namespace detail {
-template <bool config::*Cond, class Container> struct pair;
+// Cond is either a bool member of config or a predicate on it
+template <auto Cond, class Container> struct pair;
+
+template <auto Cond> constexpr bool enabled(const config &c) {
+  if constexpr (std::is_member_object_pointer_v<decltype(Cond)>) {
+    return c.*Cond;
+  } else {
+    return Cond(c);
+  }
+}
 template <class... Rs> struct tuple {};
 
 template <config C, class V, class T> struct expand_event_type_impl;
@@ -105,12 +276,13 @@ struct expand_event_type_impl<C, std::variant<Vs...>, tuple<>> {
   using type = std::variant<Vs...>;
 };
 
-template <config C, bool config::*B, class T, class... Vs, class... Rest>
+template <config C, auto B, class T, class... Vs, class... Rest>
 struct expand_event_type_impl<C, std::variant<Vs...>,
                               tuple<pair<B, T>, Rest...>> {
   using type = typename expand_event_type_impl<
       C,
-      std::conditional_t<(C.*B), std::variant<Vs..., T>, std::variant<Vs...>>,
+      std::conditional_t<enabled<B>(C), std::variant<Vs..., T>,
+                         std::variant<Vs...>>,
       tuple<Rest...>>::type;
 };
 
@@ -129,9 +301,9 @@ template <class Self, class R> struct promise_base<Self, true, R> {
   }
 };
 template <class S, config C, class P> struct expand_base_impl;
-template <class S, config C, bool config::*B, class R>
+template <class S, config C, auto B, class R>
 struct expand_base_impl<S, C, pair<B, R>> {
-  using type = promise_base<S, (C.*B), R>;
+  using type = promise_base<S, enabled<B>(C), R>;
 };
 
 template <class S, config C, class T> struct expand_base;
@@ -156,7 +328,8 @@ template <config Config = config{}> struct configurable_xml_parser {
                     detail::pair<&config::emit_processing_instruction_end,
                                  processing_instruction_end>,
                     detail::pair<&config::emit_comments, comment>,
-                    detail::pair<&config::emit_tag_content, tag_content>>;
+                    detail::pair<&config::emit_tag_content, tag_content>,
+                    detail::pair<&recovers_from_errors, parse_error>>;
 
   constexpr static inline config configuration = Config;
   using event_type = detail::expand_event_type<configuration, supported_events>;
@@ -178,6 +351,15 @@ template <config Config = config{}> struct configurable_xml_parser {
       return {handle_type::from_promise(*this)};
     }
     void unhandled_exception() noexcept { std::terminate(); }
+
+    // every nested construct gets a frame, recycle them
+    static void *operator new(std::size_t size) {
+      return frame_pool::local_allocate(size);
+    }
+    static void operator delete(void *frame, std::size_t size) noexcept {
+      frame_pool::local_deallocate(frame, size);
+    }
+
     auto yield_value(std::same_as<configurable_xml_parser> auto &&p) noexcept {
 
       bool has_value = p.has_value();
@@ -230,6 +412,9 @@ template <config Config = config{}> struct configurable_xml_parser {
   configurable_xml_parser &
   operator=(const configurable_xml_parser &other) = delete;
   configurable_xml_parser &operator=(configurable_xml_parser &&other) noexcept {
+    if (handle_ != nullptr) {
+      handle_.destroy();
+    }
     this->handle_ = std::exchange(other.handle_, nullptr);
     return *this;
   }
@@ -285,17 +470,11 @@ private:
 };
 using xml_parser = configurable_xml_parser<>;
 
-#define fail_if(cond)                                                          \
-  if (cond) {                                                                  \
-    co_return;                                                                 \
-  }
-
-#define advance_to(...) fail_if(!stream.seek(__VA_ARGS__))
-
 namespace syntax {
 inline bool find_opening_char(char_stream &stream) {
   return stream.seek(stream.find('<'));
 }
+
 std::optional<std::string_view> parse_to(char_stream &stream, auto &&func) {
   auto end = std::forward<decltype(func)>(func)(stream);
   if (end == std::string::npos) {
@@ -304,225 +483,662 @@ std::optional<std::string_view> parse_to(char_stream &stream, auto &&func) {
   return stream.consume_to(end);
 }
 
+inline name_id resolve_name(context &ctx, std::string_view name) {
+  return ctx.names != nullptr ? ctx.names->intern(name) : no_name;
+}
 
 template <config Config>
-configurable_xml_parser<Config> parse_tag_name(char_stream &stream) {
-  auto end = xml::xml_word_end(stream);
-  fail_if(end == std::string::npos);
-  auto name = stream.consume_to(end);
-  co_yield tag_open{name};
-  co_return;
+name_id resolve_name(context &ctx, std::string_view name) {
+  if constexpr (Config.recognize_names != nullptr) {
+    constexpr auto lookup = Config.recognize_names->lookup;
+    if (auto id = lookup(name); id != no_name) {
+      return id;
+    }
+  }
+  return resolve_name(ctx, name);
 }
+
 template <config Config>
-configurable_xml_parser<Config> parse_tag_close(char_stream &stream) {
-  advance_to(xml::xml_tag_head);
-  auto name = parse_to(stream, xml::xml_word_end);
-  fail_if(!name);
-  fail_if(stream.at_eos() ||
-          stream.read_char() != '>') co_yield tag_close{*name};
-  co_return;
+name_id resolve_uri(context &ctx, std::string_view uri) {
+  if (auto id = resolve_name<Config>(ctx, uri); id != no_name) {
+    return id;
+  }
+  return ctx.namespaces.uris.intern(uri);
 }
 
+// Namespace of an element or attribute name in the current scope. Attributes
+// without prefix don't belong to any namespace.
 template <config Config>
-configurable_xml_parser<Config>
-parse_single_tag_attribute(char_stream &stream) {
-  auto key = parse_to(stream, xml::xml_word_end);
-  fail_if(!key);
-  advance_to(std::not_fn(isspace));
-  if (stream.peek() != '=') {
-    co_yield tag_attribute{*key, ""};
-    co_return;
+name_id resolve_namespace(context &ctx, std::string_view name,
+                          bool is_attribute) {
+  auto prefix = name_prefix(name);
+  if (prefix.empty()) {
+    if (!is_attribute) {
+      return ctx.namespaces.find(prefix);
+    }
+    return name == "xmlns" ? resolve_uri<Config>(ctx, xmlns_namespace_uri)
+                           : no_name;
   }
-  stream.advance();
-  advance_to(std::not_fn(isspace));
-  fail_if(stream.peek() != '"');
-  stream.advance();
-  auto string_end = xml::xml_string_end(stream);
-  fail_if(string_end == std::string::npos);
-  auto value = stream.consume_to(string_end - 1);
-  advance_to(string_end);
-  co_yield tag_attribute{*key, value};
+  if (prefix == "xml") {
+    return resolve_uri<Config>(ctx, xml_namespace_uri);
+  }
+  if (prefix == "xmlns") {
+    return resolve_uri<Config>(ctx, xmlns_namespace_uri);
+  }
+  return ctx.namespaces.find(prefix);
 }
 
+// Opens a namespace scope holding the xmlns attributes of the start tag the
+// stream is in. Nothing is consumed.
 template <config Config>
-configurable_xml_parser<Config> parse_tag_attributes(char_stream &stream) {
-  while (stream) {
-    advance_to(std::not_fn(isspace));
-    if (stream.peek() == '>') {
-      stream.advance();
-      co_return;
+void declare_namespaces(char_stream &stream, context &ctx) {
+  ctx.namespaces.open();
+  auto start = stream.cursor();
+  while (stream.seek(std::not_fn(isspace)) &&
+         xml::xml_tag_head(stream.peek())) {
+    auto key_start = stream.cursor();
+    auto key_end = xml::xml_word_end(stream);
+    if (key_end == std::string::npos || !stream.seek(key_end) ||
+        !stream.seek(std::not_fn(isspace))) {
+      break;
     }
-    if (stream.peek() == '/') {
-      stream.advance();
-      fail_if(stream.at_eos() ||
-              stream.read_char() != '>') co_yield tag_self_close{};
-      co_return;
+    if (stream.peek() != '=') {
+      continue;
+    }
+    stream.advance();
+    if (!stream.seek(std::not_fn(isspace)) || stream.peek() != '"') {
+      break;
+    }
+    auto value_start = stream.cursor() + 1;
+    auto end = find_string_end(stream, value_start);
+    if (end == std::string::npos) {
+      break;
+    }
+    stream.seek(end);
+
+    auto key = stream.substring(key_start, key_end - key_start);
+    auto value = stream.substring(value_start, end - 1 - value_start);
+    if (key == "xmlns" || key.starts_with("xmlns:")) {
+      auto prefix = key == "xmlns" ? std::string_view{} : local_name(key);
+      // xmlns="" removes the default namespace
+      ctx.namespaces.declare(prefix, value.empty()
+                                         ? no_name
+                                         : resolve_uri<Config>(ctx, value));
     }
-    co_yield parse_single_tag_attribute<Config>(stream);
   }
-  co_return;
+  stream.seek(start);
 }
 
+// Start of the first `pattern` from the cursor on. For the ends of
+// comments, processing instructions and CDATA sections, where quotes have
+// no meaning.
 template <size_t S>
-size_t tag_end(char_stream &stream, const char (&pattern)[S]) {
-  const char *current = pattern;
-  auto beg = stream.cursor();
-  size_t result = std::string::npos;
+size_t find_seq(char_stream &stream, const char (&pattern)[S]) {
+  return stream.find(std::string_view{pattern, S - 1});
+}
 
-  while (stream) {
-    auto c = stream.read_char();
+// Just past the '>' that closes the markup declaration the cursor is in,
+// such as a doctype. Quoted strings are skipped, and so is an internal
+// subset in brackets, comments included. The cursor doesn't move.
+size_t declaration_end(char_stream &stream);
+
+// The steps of the grammar, shared by the event parser and sax_parse. Each
+// reads one piece of markup and returns false if that fails, with the error
+// in ctx. Building the events out of what was read, and handing them out,
+// is left to the caller.
+
+// Sets ctx.error for a step failing at the cursor, and returns false
+inline bool fail(char_stream &stream, context &ctx, std::string_view reason) {
+  ctx.error = stream_error(stream, reason);
+  ctx.stream_stopped = stream.overflowed() || stream.malformed();
+  return false;
+}
 
-    if (c == '"' && !stream.seek(xml::xml_string_end(stream))) {
-      break;
+template <class T> bool skip_to(char_stream &stream, context &ctx, T &&target) {
+  return stream.seek(std::forward<T>(target)) ||
+         fail(stream, ctx, "unexpected end of input");
+}
+
+template <config Config>
+void start_document(char_stream &stream, context &ctx) {
+  ctx.start(stream);
+  if constexpr (Config.decode_input) {
+    stream.decode_input();
+  }
+  if constexpr (Config.validate_utf8) {
+    stream.check_utf8();
+  }
+}
+
+// Once the elements are over: fails if the stream was cut short, unless a
+// step already failed for it
+inline bool end_document(char_stream &stream, context &ctx) {
+  return ctx.stream_stopped || !(stream.overflowed() || stream.malformed()) ||
+         fail(stream, ctx, {});
+}
+
+// Clears an error reported in recover mode and skips what's left of the
+// broken markup. The elements it broke off are already out of ctx.depth, and
+// their names and namespace scopes go with them.
+inline void skip_broken_markup(char_stream &stream, context &ctx) {
+  ctx.error.reset();
+  ctx.elements.close_to(ctx.depth);
+  ctx.namespaces.close_to(ctx.depth);
+  find_opening_char(stream);
+}
+
+// Moves on to the char after the cursor and reads it
+inline bool next_char(char_stream &stream, context &ctx, char &c) {
+  stream.advance();
+  if (stream.at_eos()) {
+    return fail(stream, ctx, "unexpected end of input");
+  }
+  c = stream.peek();
+  return true;
+}
+
+// The target of a processing instruction, from its '?'
+inline bool instruction_name(char_stream &stream, context &ctx,
+                             std::string_view &name) {
+  if (!skip_to(stream, ctx, xml::xml_tag_head)) {
+    return false;
+  }
+  auto end = xml::xml_word_end(stream);
+  if (end == std::string::npos) {
+    return fail(stream, ctx, "unexpected end of input");
+  }
+  name = stream.consume_to(end);
+  return true;
+}
+
+// Reads up to the next attribute of a processing instruction, or past its
+// "?>" and then sets `ended`
+inline bool next_in_instruction(char_stream &stream, context &ctx,
+                                bool &ended) {
+  if (!stream) {
+    return fail(stream, ctx, "unexpected end of input");
+  }
+  if (!skip_to(stream, ctx, std::not_fn(isspace))) {
+    return false;
+  }
+  if (stream.peek() == '>') {
+    return fail(stream, ctx, "expected '?>'");
+  }
+  ended = stream.peek() == '?';
+  if (ended) {
+    stream.advance();
+    if (stream.at_eos() || stream.read_char() != '>') {
+      return fail(stream, ctx, "expected '?>'");
     }
+  }
+  return true;
+}
 
-    if (c == *current) {
-      current++;
-      if (current == pattern + S - 1) {
-        result = stream.cursor() + 1;
-        break;
-      }
-    } else {
-      current = pattern;
+enum class declaration_kind : std::uint8_t { comment, cdata, other };
+
+// Markup opening with "<!", from the char after the '!'. Comments and CDATA
+// sections set `text` and leave the cursor at their "-->" or "]]>", to be
+// skipped once the text is handled; other declarations, such as a doctype,
+// are skipped over.
+inline bool declaration(char_stream &stream, context &ctx,
+                        declaration_kind &kind, std::string_view &text) {
+  if (stream.peek() == '-') {
+    kind = declaration_kind::comment;
+    stream.advance();
+    if (stream.at_eos() || stream.read_char() != '-') {
+      return fail(stream, ctx, "expected '<!--'");
+    }
+    auto end = find_seq(stream, "-->");
+    if (end == std::string::npos) {
+      return fail(stream, ctx, "unterminated comment");
     }
+    text = stream.consume_to(end);
+    return true;
   }
+  if (stream.peek() == '[') {
+    kind = declaration_kind::cdata;
+    if (stream.consume(7) != "[CDATA[") {
+      return fail(stream, ctx, "expected '<![CDATA['");
+    }
+    auto end = find_seq(stream, "]]>");
+    if (end == std::string::npos) {
+      return fail(stream, ctx, "unterminated CDATA section");
+    }
+    // taken as is, whitespace and all
+    text = stream.consume_to(end);
+    return true;
+  }
+  kind = declaration_kind::other;
+  auto end = declaration_end(stream);
+  if (end == std::string::npos) {
+    return fail(stream, ctx, "unterminated declaration");
+  }
+  stream.seek(end);
+  return true;
+}
 
-  stream.seek(beg);
-  return result;
+// Checks the limits before an element starts, and counts it in. The caller
+// takes it out of ctx.depth once it is over.
+inline bool enter_element(char_stream &stream, context &ctx) {
+  if (ctx.depth == ctx.limits.max_depth) {
+    return fail(stream, ctx, "nesting too deep");
+  }
+  if (ctx.nodes == ctx.limits.max_nodes) {
+    return fail(stream, ctx, "too many elements");
+  }
+  ctx.nodes++;
+  ctx.depth++;
+  return true;
 }
 
-template <size_t S>
-size_t find_seq(char_stream &stream, const char (&pattern)[S]) {
-  const char *current = pattern;
-  auto beg = stream.cursor();
+// The name of a start tag, from its first char, which is pushed on
+// ctx.elements. With namespaces, the scope of the element is opened with the
+// declarations among its attributes.
+template <config Config>
+bool start_tag_name(char_stream &stream, context &ctx,
+                    std::string_view &name) {
+  auto end = xml::xml_word_end(stream);
+  if (end == std::string::npos) {
+    return fail(stream, ctx, "unexpected end of input");
+  }
+  if (end - stream.cursor() > ctx.limits.max_name_length) {
+    return fail(stream, ctx, "name too long");
+  }
+  name = stream.consume_to(end);
+  ctx.elements.push(name);
+  if constexpr (Config.process_namespaces) {
+    declare_namespaces<Config>(stream, ctx);
+  }
+  return true;
+}
 
-  while (stream) {
-    auto c = stream.read_char();
+// Takes the innermost element out of scope, once its end is handled
+template <config Config> void close_element(context &ctx) {
+  ctx.elements.pop();
+  if constexpr (Config.process_namespaces) {
+    ctx.namespaces.close();
+  }
+}
 
-    if (c == '"' && !stream.seek(xml::xml_string_end(stream))) {
-      break;
-    }
+enum class start_tag_part : std::uint8_t { attribute, end, self_close };
 
-    if (c == *current) {
-      current++;
-      if (current == pattern + S - 1) {
-        auto result = stream.cursor();
-        stream.seek(beg);
-        return result - S + 1;
-      }
-    } else {
-      current = pattern;
+// Reads up to the next attribute of a start tag, or past its end. `count`
+// is that of the attributes so far.
+inline bool next_in_start_tag(char_stream &stream, context &ctx,
+                              std::size_t &count, start_tag_part &part) {
+  if (!stream) {
+    return fail(stream, ctx, "unexpected end of input");
+  }
+  if (!skip_to(stream, ctx, std::not_fn(isspace))) {
+    return false;
+  }
+  if (stream.peek() == '>') {
+    stream.advance();
+    part = start_tag_part::end;
+    return true;
+  }
+  if (stream.peek() == '/') {
+    stream.advance();
+    if (stream.at_eos() || stream.read_char() != '>') {
+      return fail(stream, ctx, "expected '>' after '/'");
     }
+    part = start_tag_part::self_close;
+    return true;
+  }
+  if (count++ == ctx.limits.max_attributes) {
+    return fail(stream, ctx, "too many attributes");
   }
+  part = start_tag_part::attribute;
+  return true;
+}
+
+// Where an attribute's key and value are, the value empty when it has none
+struct attribute_span {
+  std::size_t key_start;
+  std::size_t key_end;
+  std::size_t value_start;
+  std::size_t value_end;
+};
 
-  return std::string::npos;
+// An attribute, from the first char of its key
+inline bool attribute(char_stream &stream, context &ctx,
+                      attribute_span &span) {
+  auto key_start = stream.cursor();
+  auto key_end = xml::xml_word_end(stream);
+  if (key_end == std::string::npos) {
+    return fail(stream, ctx, "unexpected end of input");
+  }
+  if (key_end - key_start > ctx.limits.max_name_length) {
+    return fail(stream, ctx, "name too long");
+  }
+  stream.seek(key_end);
+  if (!skip_to(stream, ctx, std::not_fn(isspace))) {
+    return false;
+  }
+  if (stream.peek() != '=') {
+    span = {key_start, key_end, key_end, key_end};
+    return true;
+  }
+  stream.advance();
+  if (!skip_to(stream, ctx, std::not_fn(isspace))) {
+    return false;
+  }
+  if (stream.peek() != '"') {
+    return fail(stream, ctx, "expected '\"' before attribute value");
+  }
+  stream.advance();
+  auto value_start = stream.cursor();
+  auto string_end = find_string_end(stream, value_start);
+  if (string_end == std::string::npos) {
+    return fail(stream, ctx, "unterminated attribute value");
+  }
+  if (!skip_to(stream, ctx, string_end)) {
+    return false;
+  }
+  span = {key_start, key_end, value_start, string_end - 1};
+  return true;
 }
 
+// The text of an element's content up to the next markup
+inline bool content_text(char_stream &stream, context &ctx,
+                         std::string_view &text) {
+  // the whole text run up to the next tag at once
+  auto open = stream.find('<');
+  if (open == std::string::npos) {
+    return fail(stream, ctx, "unexpected end of input");
+  }
+  text = stream.consume_to(open);
+  return true;
+}
+
+// After content_text, once the text is handled: whether the markup is an
+// end tag, with the cursor left at its '/', or at the '<' of anything else
+inline bool content_markup(char_stream &stream, context &ctx, bool &end_tag) {
+  char c;
+  if (!next_char(stream, ctx, c)) {
+    return false;
+  }
+  end_tag = c == '/';
+  if (!end_tag) {
+    stream.seek(stream.cursor() - 1);
+  }
+  return true;
+}
+
+// The name of an end tag, from its '/'
+inline bool end_tag_name(char_stream &stream, context &ctx,
+                         std::string_view &name) {
+  if (!skip_to(stream, ctx, xml::xml_tag_head)) {
+    return false;
+  }
+  auto start = stream.cursor();
+  auto end = xml::xml_word_end(stream);
+  if (end == std::string::npos) {
+    return fail(stream, ctx, "unexpected end of input");
+  }
+  if (end - start > ctx.limits.max_name_length) {
+    return fail(stream, ctx, "name too long");
+  }
+  stream.seek(end);
+  if (stream.at_eos() || stream.read_char() != '>') {
+    return fail(stream, ctx, "expected '>' after closing tag name");
+  }
+  name = stream.substring(start, end - start);
+  return true;
+}
+
+// The depth in ctx.elements of the element an end tag named `name` closes,
+// 0 if none is open. Only recover mode takes another than the innermost.
 template <config Config>
-configurable_xml_parser<Config> parse_tag(char_stream &stream);
+bool match_end_tag(char_stream &stream, context &ctx, std::string_view name,
+                   std::size_t &target) {
+  target = ctx.elements.find(name);
+  if (!recovers_from_errors(Config) && target != ctx.elements.size()) {
+    return fail(stream, ctx, "mismatched closing tag");
+  }
+  return true;
+}
+
+// In recover mode, for an end tag that doesn't close the innermost element:
+// the error to report. If it closes an outer one, the elements inside that
+// are to be closed as well.
+inline parse_error mismatched_end_tag(char_stream &stream, context &ctx,
+                                      std::size_t target) {
+  if (target == 0) {
+    return stream_error(stream, "closing tag without an opening one");
+  }
+  ctx.elements.unwind_to(target);
+  return stream_error(stream, "mismatched closing tag");
+}
+
+// Whether the innermost element is to be closed because an end tag closed
+// it or an element around it. Closing the last of them ends the unwinding.
+inline bool unwinding(context &ctx) {
+  auto target = ctx.elements.unwinding();
+  if (target == ctx.elements.size()) {
+    ctx.elements.unwind_to(0);
+  }
+  return target != 0;
+}
+
 template <config Config>
-configurable_xml_parser<Config> parse_tag_content(char_stream &stream) {
-  auto cursor = stream.cursor();
-  bool only_space = true;
-  while (stream) {
-    auto c = stream.peek();
-    if (c == '<') {
-      if (!only_space) {
-        auto content = stream.substring(cursor, stream.cursor() - cursor);
-        co_yield tag_content{content};
-        only_space = true;
-      }
+tag_open make_tag_open(context &ctx, std::string_view name) {
+  if constexpr (Config.process_namespaces) {
+    return {name, resolve_name<Config>(ctx, name),
+            resolve_namespace<Config>(ctx, name, false), local_name(name)};
+  } else {
+    return {name, resolve_name<Config>(ctx, name)};
+  }
+}
+
+template <config Config>
+tag_close make_tag_close(context &ctx, std::string_view name) {
+  if constexpr (Config.process_namespaces) {
+    return {name, resolve_name<Config>(ctx, name),
+            resolve_namespace<Config>(ctx, name, false), local_name(name)};
+  } else {
+    return {name, resolve_name<Config>(ctx, name)};
+  }
+}
+
+template <config Config>
+tag_attribute make_attribute(context &ctx, std::string_view key,
+                             std::string_view value) {
+  if constexpr (Config.process_namespaces) {
+    return {key, value, resolve_name<Config>(ctx, key),
+            resolve_namespace<Config>(ctx, key, true), local_name(key)};
+  } else {
+    return {key, value, resolve_name<Config>(ctx, key)};
+  }
+}
+
+// The event for an attribute read by attribute()
+template <config Config>
+tag_attribute make_attribute(char_stream &stream, context &ctx,
+                             const attribute_span &span) {
+  return make_attribute<Config>(
+      ctx, stream.substring(span.key_start, span.key_end - span.key_start),
+      stream.substring(span.value_start, span.value_end - span.value_start));
+}
+} // namespace syntax
+
+// Runs a step of the grammar, unwinding if it fails
+#define require(...)                                                           \
+  if (!(__VA_ARGS__)) {                                                        \
+    co_return;                                                                 \
+  }
+
+// After a nested parser, unwinds up to the nearest point that can recover
+#define propagate_error()                                                      \
+  if (ctx.error) {                                                             \
+    co_return;                                                                 \
+  }
 
-      stream.advance();
-      fail_if(stream.at_eos());
-      auto n = stream.peek();
+namespace syntax {
+// Called where a nested parser may have failed and parsing can go on. Stop
+// mode unwinds; recover mode emits the error and skips what's left of the
+// broken markup.
+template <config Config>
+configurable_xml_parser<Config> recover(char_stream &stream, context &ctx) {
+  if constexpr (recovers_from_errors(Config)) {
+    co_yield *ctx.error;
+    skip_broken_markup(stream, ctx);
+  }
+  co_return;
+}
+template <config Config>
+configurable_xml_parser<Config> parse_tag(char_stream &stream, context &ctx);
+template <config Config>
+configurable_xml_parser<Config> parse_tag_content(char_stream &stream,
+                                                  context &ctx) {
+  while (stream) {
+    std::string_view text;
+    require(content_text(stream, ctx, text));
+    if (!xml::is_blank(text)) {
+      co_yield tag_content{text};
+    }
 
-      if (n == '/') {
-        co_yield parse_tag_close<Config>(stream);
+    bool end_tag;
+    require(content_markup(stream, ctx, end_tag));
+    if (end_tag) {
+      std::string_view name;
+      std::size_t target;
+      require(end_tag_name(stream, ctx, name));
+      require(match_end_tag<Config>(stream, ctx, name, target));
+      if (target == ctx.elements.size()) {
+        co_yield make_tag_close<Config>(ctx, name);
+        close_element<Config>(ctx);
         co_return;
-      } else {
-        stream.seek(stream.cursor() - 1);
-        co_yield parse_tag<Config>(stream);
+      }
+      if constexpr (recovers_from_errors(Config)) {
+        co_yield mismatched_end_tag(stream, ctx, target);
       }
     } else {
-      if (!isspace(c)) {
-        only_space = false;
+      co_yield parse_tag<Config>(stream, ctx);
+      if (ctx.error) {
+        co_yield recover<Config>(stream, ctx);
+        propagate_error();
       }
-      stream.advance();
     }
-  }
-}
-template <config Config>
-configurable_xml_parser<Config>
-parse_processing_instruction(char_stream &stream) {
-  while (stream) {
-    advance_to(std::not_fn(isspace));
-    fail_if(stream.peek() == '>');
-    if (stream.peek() == '?') {
-      stream.advance();
-      fail_if(stream.at_eos() ||
-              stream.read_char() != '>') co_yield processing_instruction_end{};
+    // closed by an end tag that belongs further out
+    if (unwinding(ctx)) {
+      co_yield make_tag_close<Config>(ctx, ctx.elements.innermost());
+      close_element<Config>(ctx);
       co_return;
     }
-    co_yield parse_single_tag_attribute<Config>(stream);
   }
-  co_return;
 }
 
 template <config Config>
-configurable_xml_parser<Config> parse_tag(char_stream &stream) {
-  stream.advance();
-  fail_if(stream.at_eos());
-  switch (stream.peek()) {
+configurable_xml_parser<Config> parse_tag(char_stream &stream,
+                                          context &ctx) {
+  char c;
+  require(next_char(stream, ctx, c));
+  switch (c) {
   case '?': {
-    advance_to(xml::xml_tag_head);
-    auto name_end = xml::xml_word_end(stream);
-    fail_if(name_end == std::string::npos);
-    co_yield processing_instruction_begin{stream.consume_to(name_end)};
-    co_yield parse_processing_instruction<Config>(stream);
+    std::string_view name;
+    require(instruction_name(stream, ctx, name));
+    co_yield processing_instruction_begin{name};
+    for (bool ended = false;;) {
+      require(next_in_instruction(stream, ctx, ended));
+      if (ended) {
+        break;
+      }
+      attribute_span span;
+      require(attribute(stream, ctx, span));
+      co_yield make_attribute<Config>(stream, ctx, span);
+    }
+    co_yield processing_instruction_end{};
     break;
   }
+  case '/':
+    // outside every element, as content_markup takes the others
+    fail(stream, ctx, "closing tag without an opening one");
+    break;
   case '!': {
-    stream.advance();
-    fail_if(stream.at_eos());
-    if (stream.peek() == '-') {
-      stream.advance();
-      fail_if(stream.read_char() != '-');
-      auto end = find_seq(stream, "-->");
-      fail_if(end == std::string::npos);
-      co_yield comment{stream.consume_to(end)};
-      break;
+    require(next_char(stream, ctx, c));
+    declaration_kind kind;
+    std::string_view text;
+    require(declaration(stream, ctx, kind, text));
+    if (kind == declaration_kind::comment) {
+      co_yield comment{text};
+      stream.advance(3);
+    } else if (kind == declaration_kind::cdata) {
+      if (!text.empty()) {
+        co_yield tag_content{text, true};
+      }
+      stream.advance(3);
     }
-
-    auto end = tag_end(stream, ">");
-    fail_if(end == std::string::npos);
     break;
   }
   default: {
-    co_yield parse_tag_name<Config>(stream);
-    co_yield parse_tag_attributes<Config>(stream);
-    co_yield parse_tag_content<Config>(stream);
+    require(enter_element(stream, ctx));
+    DEFER { ctx.depth--; };
+
+    std::string_view name;
+    require(start_tag_name<Config>(stream, ctx, name));
+    co_yield make_tag_open<Config>(ctx, name);
+    std::size_t count = 0;
+    auto part = start_tag_part::attribute;
+    for (;;) {
+      require(next_in_start_tag(stream, ctx, count, part));
+      if (part != start_tag_part::attribute) {
+        break;
+      }
+      attribute_span span;
+      require(attribute(stream, ctx, span));
+      co_yield make_attribute<Config>(stream, ctx, span);
+    }
+    if (part == start_tag_part::self_close) {
+      co_yield tag_self_close{};
+      close_element<Config>(ctx);
+    } else {
+      co_yield parse_tag_content<Config>(stream, ctx);
+    }
   }
   }
   co_return;
 }
-}//namespace syntax
 
-template <config Config>
-configurable_xml_parser<Config> parse_xml(char_stream &stream) {
+// The whole document. `Context` is either context & or context, so that
+// parse_xml without a context keeps its own in this frame rather than in
+// one more nested parser.
+template <config Config, class Context>
+configurable_xml_parser<Config> parse_document(char_stream &stream,
+                                               Context ctx) {
+  start_document<Config>(stream, ctx);
   while (stream) {
-    if (!syntax::find_opening_char(stream)) {
-      co_return;
+    if (!find_opening_char(stream)) {
+      break;
     }
 
-    co_yield syntax::parse_tag<Config>(stream);
+    co_yield parse_tag<Config>(stream, ctx);
+    if (ctx.error) {
+      co_yield recover<Config>(stream, ctx);
+      propagate_error();
+    }
+  }
+  // cut short between two elements
+  if (!end_document(stream, ctx)) {
+    co_yield recover<Config>(stream, ctx);
   }
 }
+}//namespace syntax
+
+template <config Config>
+configurable_xml_parser<Config> parse_xml(char_stream &stream, context &ctx) {
+  return syntax::parse_document<Config, context &>(stream, ctx);
+}
+
+template <config Config>
+configurable_xml_parser<Config> parse_xml(char_stream &stream) {
+  return syntax::parse_document<Config, context>(stream, context{});
+}
 
 inline xml_parser parse_xml(char_stream &stream) {
   return parse_xml<config{}>(stream);
 }
 
-#undef fail_if
-#undef advance_to
+#undef require
+#undef propagate_error
 } // namespace xml
@@ -0,0 +1,125 @@
+#include "async.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <utility>
+#include <unistd.h>
+#include <vector>
+
+using namespace xml;
+
+// Parses many documents at once on one thread, while another thread writes
+// them out in small interleaved pieces through pipes and socket pairs
+int main(int argc, char *argv[]) {
+  std::size_t streams = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100;
+
+  std::string document = "<?xml version=\"1.0\"?>\n<feed>\n";
+  for (int i = 0; i < 200; ++i) {
+    document += "  <entry id=\"" + std::to_string(i) +
+                "\"><!-- entry --><title>Entry " + std::to_string(i) +
+                "</title><empty/></entry>\n";
+  }
+  document += "</feed>\n";
+
+  std::vector<int> readers, writers;
+  for (std::size_t i = 0; i < streams; ++i) {
+    int fds[2];
+    int created = i % 2 == 0 ? ::pipe(fds)
+                             : ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    if (created != 0) {
+      std::cerr << "cannot create stream " << i << std::endl;
+      return EXIT_FAILURE;
+    }
+    readers.push_back(fds[0]);
+    writers.push_back(fds[1]);
+  }
+
+  std::thread writer{[&] {
+    constexpr std::size_t piece = 37;
+    for (std::size_t offset = 0; offset < document.size(); offset += piece) {
+      auto part = std::string_view{document}.substr(offset, piece);
+      for (int fd : writers) {
+        if (::write(fd, part.data(), part.size()) < 0) {
+          std::cerr << "write failed" << std::endl;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    for (int fd : writers) {
+      ::close(fd);
+    }
+  }};
+
+  async::event_loop loop;
+  std::vector<std::size_t> events(streams, 0);
+  std::size_t finished = 0, failed = 0;
+  for (std::size_t i = 0; i < streams; ++i) {
+    async::parse(
+        loop, readers[i], [&events, i](auto &&) { events[i]++; },
+        [&, i](const context &ctx) {
+          finished++;
+          if (ctx.error) {
+            failed++;
+            std::cerr << "stream " << i << " failed at " << ctx.error->offset
+                      << ": " << ctx.error->reason << std::endl;
+          }
+        });
+  }
+  loop.run();
+  writer.join();
+  for (int fd : readers) {
+    ::close(fd);
+  }
+
+  std::size_t total = 0;
+  for (auto n : events) {
+    total += n;
+  }
+  std::cout << finished << " streams, " << failed << " failed, " << total
+            << " events (" << (streams ? total / streams : 0)
+            << " per stream)" << std::endl;
+
+  // A peer that stalls mustn't hold up the others, even right after a quoted
+  // '>' that doesn't end the markup: the document that is already there is
+  // done first
+  std::string quoted = "<!DOCTYPE feed [<!ENTITY e \"1 > 0\">]><feed/>";
+  auto split = quoted.find('>', quoted.find('"')) + 1;
+  int silent[2], ready[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, silent) != 0 ||
+      ::socketpair(AF_UNIX, SOCK_STREAM, 0, ready) != 0 ||
+      ::write(ready[1], document.data(), document.size()) < 0 ||
+      ::write(silent[1], quoted.data(), split) < 0) {
+    std::cerr << "cannot set up the silent peer" << std::endl;
+    return EXIT_FAILURE;
+  }
+  ::close(ready[1]);
+  std::thread late{[&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    if (::write(silent[1], quoted.data() + split, quoted.size() - split) < 0) {
+      std::cerr << "write failed" << std::endl;
+    }
+    ::close(silent[1]);
+  }};
+  std::vector<std::string> order;
+  async::event_loop waiting_loop;
+  for (auto [fd, name] : {std::pair{silent[0], "silent"},
+                          std::pair{ready[0], "ready"}}) {
+    async::parse(
+        waiting_loop, fd, [](auto &&) {},
+        [&order, name](const context &) { order.emplace_back(name); });
+  }
+  waiting_loop.run();
+  late.join();
+  ::close(silent[0]);
+  ::close(ready[0]);
+  bool responsive = order == std::vector<std::string>{"ready", "silent"};
+  std::cout << "silent peer "
+            << (responsive ? "waited for" : "blocked the loop") << std::endl;
+
+  return failed == 0 && finished == streams && responsive ? EXIT_SUCCESS
+                                                          : EXIT_FAILURE;
+}
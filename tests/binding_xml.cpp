@@ -0,0 +1,107 @@
+#include "binding.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace xml;
+
+namespace {
+struct item {
+  int id{0};
+  double price{0};
+  std::string name;
+  bool operator==(const item &) const = default;
+};
+
+struct order {
+  std::string ref;
+  bool paid{false};
+  std::string note;
+  std::vector<item> items;
+  std::vector<std::string> tags;
+  bool operator==(const order &) const = default;
+};
+
+struct customer {
+  std::string name;
+  order last;
+  bool operator==(const customer &) const = default;
+};
+
+constexpr auto item_binding =
+    bind::object<item>(bind::attribute("id", &item::id),
+                       bind::element("price", &item::price),
+                       bind::element("name", &item::name));
+constexpr auto order_binding = bind::object<order>(
+    bind::attribute("ref", &order::ref), bind::attribute("paid", &order::paid),
+    bind::content(&order::note),
+    bind::elements("item", &order::items, item_binding),
+    bind::elements("tag", &order::tags));
+constexpr auto customer_binding =
+    bind::object<customer>(bind::attribute("name", &customer::name),
+                           bind::element("order", &customer::last,
+                                         order_binding));
+
+// The document a customer is read back from, with the text of the order
+// split around its elements and something the binding doesn't know about
+std::string to_xml(const customer &c) {
+  auto &o = c.last;
+  std::string out = "<customer name=\"" + c.name + "\">\n<order ref=\"" +
+                    o.ref + "\" paid=\"" + (o.paid ? "true" : "false") +
+                    "\">" + o.note.substr(0, 5);
+  for (auto &i : o.items) {
+    out += "<item id=\"" + std::to_string(i.id) + "\"><price>" +
+           std::to_string(i.price) + "</price><name>" + i.name +
+           "</name><unknown><name>x</name></unknown></item>";
+  }
+  out += o.note.substr(5);
+  for (auto &t : o.tags) {
+    out += "<tag>" + t + "</tag>";
+  }
+  return out + "</order>\n</customer>\n";
+}
+} // namespace
+
+// Writes a customer out as XML, reads it back through a binding and checks
+// that nothing was lost, then reads each item of the same document on its
+// own
+int main() {
+  customer expected{
+      .name = "Ada",
+      .last = {.ref = "A-17",
+               .paid = true,
+               .note = "leave at the door",
+               .items = {{.id = 1, .price = 2.5, .name = "tea"},
+                         {.id = 2, .price = 10.25, .name = "pot"}},
+               .tags = {"gift", "fragile"}},
+  };
+  auto document = to_xml(expected);
+
+  auto stream = read_string(document);
+  auto read_back = bind::read(stream, customer_binding);
+  if (!read_back || *read_back != expected) {
+    std::cerr << "the customer didn't read back the same" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<item> items;
+  auto again = read_string(document);
+  bool ok = bind::read_each(again, "item", item_binding,
+                            [&](item i) { items.push_back(std::move(i)); });
+  if (!ok || items != expected.last.items) {
+    std::cerr << "read_each didn't find the same items" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  auto bad = read_string("<item id=\"three\"/>");
+  if (bind::read(bad, item_binding)) {
+    std::cerr << "a malformed number was accepted" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << read_back->name << ": order " << read_back->last.ref << ", "
+            << read_back->last.items.size() << " items, "
+            << read_back->last.tags.size() << " tags" << std::endl;
+}
@@ -0,0 +1,91 @@
+#include "compact_event.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <variant>
+#include <vector>
+
+using namespace xml;
+
+namespace {
+constexpr config cfg{.emit_comments = true};
+
+std::string describe(const configurable_xml_parser<cfg>::event_type &event) {
+  return std::visit(
+      [](const auto &e) {
+        std::string result;
+        if constexpr (requires { e.name; }) {
+          result.append(e.name);
+        }
+        if constexpr (requires { e.key; }) {
+          result.append(e.key).append("=").append(e.value);
+        }
+        if constexpr (requires { e.content; }) {
+          result.append(e.content).append(e.cdata ? " as CDATA" : "");
+        }
+        if constexpr (requires { e.comment; }) {
+          result.append(e.comment);
+        }
+        return result;
+      },
+      event);
+}
+} // namespace
+
+// Encodes every event of FILE, moves the text somewhere else and checks that
+// the events decode to the same ones
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: compact_events <FILE>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto stream = slurp_file(argv[1]);
+  context ctx;
+  auto parser = parse_xml<cfg>(stream, ctx);
+  std::vector<compact_event> events;
+  std::vector<std::string> expected;
+  while (parser) {
+    auto event = parser.event();
+    auto encoded = encode_event(stream, 0, event);
+    if (!encoded) {
+      std::cerr << "event " << events.size() << " doesn't fit" << std::endl;
+      return EXIT_FAILURE;
+    }
+    events.push_back(*encoded);
+    expected.push_back(describe(event));
+  }
+  if (ctx.error) {
+    std::cerr << "failed at " << ctx.error->offset << ": "
+              << ctx.error->reason << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string moved;
+  stream.for_each_buffered(0, [&](std::string_view piece) { moved += piece; });
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    auto decoded = decode_event<cfg>(events[i], moved);
+    if (!decoded || describe(*decoded) != expected[i]) {
+      std::cerr << "event " << i << " doesn't decode" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  compact_event past_end{
+      .offset = static_cast<std::uint32_t>(moved.size()),
+      .length = 1,
+      .extra = 0,
+      .value_gap = 0,
+      .kind = event_kind::tag_content,
+  };
+  if (decode_event<cfg>(past_end, moved)) {
+    std::cerr << "an event past the end of its text decoded" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << events.size() << " events, "
+            << events.size() * sizeof(compact_event) << " bytes encoded, "
+            << events.size() *
+                   sizeof(configurable_xml_parser<cfg>::event_type)
+            << " bytes as variants" << std::endl;
+  return EXIT_SUCCESS;
+}
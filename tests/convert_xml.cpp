@@ -0,0 +1,44 @@
+#include "convert.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+using namespace xml;
+
+// Flattens the RECORD elements of FILE to JSON lines or CSV on stdout, one
+// column per FIELD given as "column=path" or "path"
+int main(int argc, char *argv[]) {
+  if (argc < 5) {
+    std::cerr << "usage: convert_xml <json|csv> <FILE> <RECORD> <FIELD>..."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string_view format_name = argv[1];
+  if (format_name != "json" && format_name != "csv") {
+    std::cerr << "unknown format " << format_name << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto format = format_name == "json" ? output_format::json_lines
+                                      : output_format::csv;
+
+  record_mapping mapping{.record = argv[3], .fields = {}};
+  for (int i = 4; i < argc; ++i) {
+    mapping.fields.push_back(parse_field(argv[i]));
+  }
+
+  auto stream = slurp_file(argv[2]);
+  buffered_writer out{1, 1 << 20};
+  context ctx;
+  auto records = convert_records(stream, mapping, format, out, ctx);
+  if (!out.flush()) {
+    std::cerr << "cannot write the output" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (ctx.error) {
+    std::cerr << "failed after " << records << " records at "
+              << ctx.error->offset << ": " << ctx.error->reason << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#include "doc_cache.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+using namespace xml;
+
+namespace {
+bool write_file(const char *path, const std::string &content) {
+  std::ofstream out{path, std::ios::binary | std::ios::trunc};
+  out << content;
+  return static_cast<bool>(out.flush());
+}
+
+bool expect(const doc_cache &cache, std::uint64_t hits, std::uint64_t misses,
+            std::size_t documents) {
+  auto stats = cache.stats();
+  std::cout << "hits " << stats.hits << ", misses " << stats.misses << ", "
+            << stats.documents << " documents" << std::endl;
+  return stats.hits == hits && stats.misses == misses &&
+         stats.documents == documents;
+}
+} // namespace
+
+// Loads FILE through a cache twice, then a copy of it written to COPY, and
+// checks that only the first load parses. Then grows the copy by a newline
+// and checks that it gets a document of its own.
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: doc_cache_xml <FILE> <COPY>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::ifstream in{argv[1], std::ios::binary};
+  std::string content{std::istreambuf_iterator<char>{in}, {}};
+  if (!in || !write_file(argv[2], content)) {
+    std::cerr << "cannot copy " << argv[1] << " to " << argv[2] << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  doc_cache cache{std::size_t{1} << 30};
+  auto first = cache.load(argv[1]);
+  auto again = cache.load(argv[1]);
+  auto copy = cache.load(argv[2]);
+  if (!first || again != first || copy != first ||
+      !expect(cache, 2, 1, 1)) {
+    std::cerr << "the same content wasn't served from the cache" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!write_file(argv[2], content + '\n')) {
+    std::cerr << "cannot write " << argv[2] << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto grown = cache.load(argv[2]);
+  if (!grown || grown == first || !expect(cache, 2, 2, 2)) {
+    std::cerr << "a changed file was served the old document" << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,82 @@
+#include "dom_index.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace xml;
+
+namespace {
+constexpr std::string_view document = R"(<shop>
+  <item id="1" kind="tea"><name>green</name></item>
+  <item id="2" kind="pot"/>
+  <box>
+    <item id="3" kind="tea"><name>black</name></item>
+  </box>
+  <note kind="tea"/>
+</shop>)";
+
+// The ids of `found`, in order
+std::string ids(const dom_index::nodes &found) {
+  std::string out;
+  for (auto *node : found) {
+    for (auto &attr : node->attributes) {
+      if (attr.name == "id") {
+        out += attr.value;
+      }
+    }
+  }
+  return out;
+}
+
+bool check(const dom_index &index) {
+  auto *second = index.find_first("id", "2");
+  return ids(index.elements("item")) == "123" &&
+         index.elements("name").size() == 2 &&
+         index.elements("missing").empty() &&
+         index.find("kind", "tea").size() == 3 &&
+         ids(index.find("kind", "tea")) == "13" &&
+         index.find("kind", "cup").empty() &&
+         index.find("size", "tea").empty() && second != nullptr &&
+         second->name == "item" && index.find_first("id", "4") == nullptr;
+}
+} // namespace
+
+// Indexes a small document up front and lazily, with the lazy index built
+// by whichever of several threads asks first, and checks what the lookups
+// find and their document order
+int main() {
+  auto stream = read_string(document);
+  auto doc = build_xml_doc(stream);
+  if (!doc) {
+    std::cerr << "the document didn't build" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  dom_index eager{*doc};
+  if (!check(eager)) {
+    std::cerr << "the index found the wrong nodes" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  dom_index lazy{*doc, true};
+  std::vector<char> agreed(4, false);
+  {
+    std::vector<std::jthread> threads;
+    for (std::size_t i = 0; i < agreed.size(); ++i) {
+      threads.emplace_back([&, i] { agreed[i] = check(lazy); });
+    }
+  }
+  for (auto ok : agreed) {
+    if (!ok) {
+      std::cerr << "the lazy index found the wrong nodes" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  std::cout << eager.elements("item").size() << " items, "
+            << eager.find("kind", "tea").size() << " with kind=tea"
+            << std::endl;
+}
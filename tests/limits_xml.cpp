@@ -0,0 +1,124 @@
+#include "xml.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+using namespace xml;
+
+namespace {
+std::string nested(std::size_t depth) {
+  std::string doc;
+  for (std::size_t i = 0; i < depth; ++i) {
+    doc += "<a>";
+  }
+  for (std::size_t i = 0; i < depth; ++i) {
+    doc += "</a>";
+  }
+  return doc;
+}
+
+std::string with_attributes(std::size_t count) {
+  std::string doc = "<a";
+  for (std::size_t i = 0; i < count; ++i) {
+    doc += " k" + std::to_string(i) + "=\"v\"";
+  }
+  return doc + "/>";
+}
+
+std::string named(std::size_t length) {
+  return '<' + std::string(length, 'a') + "/>";
+}
+
+// `count` elements in all, the root among them
+std::string with_elements(std::size_t count) {
+  std::string doc = "<r>";
+  for (std::size_t i = 1; i < count; ++i) {
+    doc += "<b/>";
+  }
+  return doc + "</r>";
+}
+
+// Hands `text` over in pieces of `size` bytes
+char_stream in_pieces(std::string text, std::size_t size) {
+  for (std::size_t at = 0; at < text.size(); at += size) {
+    co_yield std::string_view{text}.substr(at, size);
+  }
+  co_return true;
+}
+
+// The reason the event parser failed for, empty if it didn't. Freeing what
+// was read after every event keeps the buffer small.
+std::string_view parse(char_stream &stream, parse_limits limits,
+                       bool discard = false) {
+  context ctx;
+  ctx.limits = limits;
+  auto parser = parse_xml<config{}>(stream, ctx);
+  while (parser) {
+    parser.event();
+    if (discard) {
+      stream.discard_consumed();
+    }
+  }
+  return ctx.error ? ctx.error->reason : "";
+}
+
+std::string_view build(std::string_view document, parse_limits limits) {
+  context ctx;
+  ctx.limits = limits;
+  auto stream = read_string(document);
+  auto doc = build_xml_doc(stream, ctx);
+  if (ctx.error) {
+    return ctx.error->reason;
+  }
+  return doc ? "" : "no document";
+}
+
+// Whether a document of `make(limit)` passes both parsers with `limits`,
+// and one of `make(limit + 1)` fails both for `reason`
+bool exact(std::string (*make)(std::size_t), std::size_t limit,
+           parse_limits limits, std::string_view reason) {
+  auto within = make(limit), over = make(limit + 1);
+  auto within_stream = read_string(within), over_stream = read_string(over);
+  auto results = {parse(within_stream, limits), build(within, limits),
+                  parse(over_stream, limits), build(over, limits)};
+  auto expected = {std::string_view{}, std::string_view{}, reason, reason};
+  if (std::equal(results.begin(), results.end(), expected.begin())) {
+    return true;
+  }
+  std::cerr << reason << " at " << limit << ", got:";
+  for (auto result : results) {
+    std::cerr << " '" << result << "'";
+  }
+  std::cerr << std::endl;
+  return false;
+}
+} // namespace
+
+// Checks that every limit lets a document reach it and stops one that goes
+// one past it, in the event parser and in the tree builder alike, and that
+// the buffer limit holds unless what was read is freed as the parse goes
+int main() {
+  if (!exact(nested, 16, {.max_depth = 16}, "nesting too deep") ||
+      !exact(with_attributes, 8, {.max_attributes = 8},
+             "too many attributes") ||
+      !exact(named, 32, {.max_name_length = 32}, "name too long") ||
+      !exact(with_elements, 100, {.max_nodes = 100}, "too many elements")) {
+    return EXIT_FAILURE;
+  }
+
+  // Memory is freed a whole chunk at a time, so the limit allows a few
+  auto large = with_elements(1 << 18);
+  parse_limits buffer{.max_buffered_bytes = 4 * chunk_buffer::chunk_size};
+  auto kept = in_pieces(large, 4096), freed = in_pieces(large, 4096);
+  if (parse(kept, buffer) != "buffer limit exceeded" ||
+      parse(freed, buffer, true) != "") {
+    std::cerr << "the buffer limit didn't hold" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "all limits hold" << std::endl;
+}
@@ -0,0 +1,86 @@
+#include "line_index.hpp"
+#include "xml.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <variant>
+
+using namespace xml;
+
+namespace {
+constexpr std::string_view document = "<catalog>\n"
+                                      "  <book id=\"1\">\n"
+                                      "    <title>First</title>\n"
+                                      "  </book>\n"
+                                      "\n"
+                                      "  <book id=\"2\"><title>Second</title>\n"
+                                      "  </book>\n"
+                                      "</catalog>\n";
+
+// Where each start tag's name and each attribute's key is
+constexpr std::string_view expected = "catalog 1:2\n"
+                                      "book 2:4\n"
+                                      "id 2:9\n"
+                                      "title 3:6\n"
+                                      "book 6:4\n"
+                                      "id 6:9\n"
+                                      "title 6:17\n";
+
+// Hands `text` over a line at a time, so that each line lands in the
+// stream only once the parser asks for more
+char_stream by_line(std::string_view text) {
+  while (!text.empty()) {
+    auto end = text.find('\n');
+    end = end == std::string_view::npos ? text.size() : end + 1;
+    co_yield text.substr(0, end);
+    text.remove_prefix(end);
+  }
+  co_return true;
+}
+
+std::string at(line_index::position pos) {
+  return std::to_string(pos.line) + ':' + std::to_string(pos.column);
+}
+} // namespace
+
+// Parses a document fed a line at a time, freeing what the parser is done
+// with as it goes, and checks the line and column given for every start tag
+// and attribute, then for the error in a broken document
+int main() {
+  auto stream = by_line(document);
+  context ctx;
+  line_index lines;
+  std::string found;
+  auto parser = parse_xml<config{}>(stream, ctx);
+  while (parser) {
+    auto event = parser.event();
+    auto pos = lines.locate(stream, event_offset(stream, event));
+    if (auto *open = std::get_if<tag_open>(&event)) {
+      found += std::string{open->name} + ' ' + at(pos) + '\n';
+    } else if (auto *attr = std::get_if<tag_attribute>(&event)) {
+      found += std::string{attr->key} + ' ' + at(pos) + '\n';
+    }
+    stream.discard_consumed();
+  }
+  if (ctx.error || found != expected) {
+    std::cerr << "the tags were placed at\n" << found;
+    return EXIT_FAILURE;
+  }
+
+  auto broken = read_string("<a>\n  <b>\n  </c>\n</a>");
+  context broken_ctx;
+  auto broken_parser = parse_xml<config{}>(broken, broken_ctx);
+  while (broken_parser) {
+    broken_parser.event();
+  }
+  // The error is at the end of the name that doesn't match, the '>' of </c>
+  line_index broken_lines;
+  if (!broken_ctx.error ||
+      at(broken_lines.locate(broken, broken_ctx.error->offset)) != "3:7") {
+    std::cerr << "the error wasn't placed at 3:7" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << found;
+}
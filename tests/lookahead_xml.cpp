@@ -0,0 +1,175 @@
+#include "async.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+using namespace xml;
+using namespace xml::async;
+
+namespace {
+// Pieces of documents, well formed or not, with the markup the lookahead
+// has to step through the way the parser does: quotes hiding '>', doctype
+// subsets, comments and CDATA sections cut short, namespaces
+constexpr std::string_view pieces[] = {
+    "<a>", "</a>", "<b x=\"1\">", "<b x=\"a>b\" y='q\"z'>", "</b>", "<c/>",
+    "<c />", "text", "  ", "\n", "<!-- c > -- -->", "<![CDATA[x]]>",
+    "<![CDATA[]]>", "<?pi a=\"1?>\" ?>", "<?pi?>", "<?x y ?>",
+    "<!DOCTYPE d [<!ENTITY e \"v>\"> <!-- ] > --> ]>", "<!DOCTYPE q 'x>'>",
+    "<d xmlns=\"u\" xmlns:p=\"v\">", "</d>", "<p:e>", "</p:e>", "<e a>",
+    "<e a=b>", "<e a = \"v\" >", "</ x>", "<", ">", "\"", "<!x", "<?", "< a>",
+    "<a/x>", "]]>", "<!-", "<![CDA", "<f\n  g=\"h\"\n/>", "<1>",
+    "<g xmlns:q=\"w\" k x=\"y\"/>", "<!--->", "<!---->", "-->", "/", "=",
+    "<verylongname>", "</verylongname>", "<m a=\"1\" b=\"2\" c=\"3\">",
+    "</m>"};
+
+// Hands over `first`, then `second` once the parser asks for more, noting
+// when that happens
+char_stream in_two(std::string first, std::string second, bool *asked) {
+  co_yield first;
+  *asked = true;
+  co_yield second;
+  co_return true;
+}
+
+// Every event that tells where the parser stands, as async::parse has them
+constexpr config every_event(config c) {
+  c.emit_tag_open = c.emit_tag_close = c.emit_tag_self_close = true;
+  c.emit_tag_attribute = c.emit_tag_content = c.emit_comments = true;
+  c.emit_processing_instruction_begin = true;
+  c.emit_processing_instruction_end = true;
+  return c;
+}
+
+// The kind of `event` and the text it carries. Offsets won't do: the end
+// tags recover mode makes up are named from the parser's own copy.
+std::string describe(const auto &event) {
+  auto text = std::visit(
+      [](const auto &e) -> std::string_view {
+        if constexpr (requires { e.name; }) {
+          return e.name;
+        } else if constexpr (requires { e.key; }) {
+          return e.key;
+        } else if constexpr (requires { e.content; }) {
+          return e.content;
+        } else if constexpr (requires { e.comment; }) {
+          return e.comment;
+        } else if constexpr (requires { e.reason; }) {
+          return e.reason;
+        } else {
+          return {};
+        }
+      },
+      event);
+  return std::to_string(event.index()) + ' ' + std::string{text} + '\n';
+}
+
+struct results {
+  std::size_t checks{0};
+  std::size_t wrong{0};
+};
+
+// Cuts `document` in two at every offset, and checks the lookahead before
+// every event the parser gets to without the second part: it must say the
+// parser won't need it, and must not when it does. The events must then
+// be the same as when the whole document is there from the start.
+template <config Config>
+void check_splits(std::string_view document, parse_limits limits,
+                  results &counts) {
+  constexpr auto every = every_event(Config);
+  auto describe_all = [&](char_stream &stream, auto on_event) {
+    context ctx;
+    ctx.limits = limits;
+    ctx.start(stream);
+    auto parser = parse_xml<every>(stream, ctx);
+    std::string events;
+    parse_position position;
+    buffered_text text;
+    for (;;) {
+      text.assign(stream);
+      bool ready = next_event_buffered(text, position, std::as_const(ctx),
+                                       Config.process_namespaces);
+      bool alive = bool(parser);
+      on_event(ready);
+      if (!alive) {
+        return ctx.error ? events + std::string{ctx.error->reason} : events;
+      }
+      auto event = parser.event();
+      events += describe(event);
+      std::visit([&](const auto &e) { position.pass(e, ctx); }, event);
+    }
+  };
+
+  auto whole = read_string(document);
+  auto expected = describe_all(whole, [](bool) {});
+  for (std::size_t cut = 0; cut <= document.size(); ++cut) {
+    bool asked = false, judged = true;
+    auto stream = in_two(std::string{document.substr(0, cut)},
+                         std::string{document.substr(cut)}, &asked);
+    auto events = describe_all(stream, [&](bool ready) {
+      // past the first read for more, the second part is buffered too
+      if (!judged) {
+        return;
+      }
+      counts.checks++;
+      if (ready == asked) {
+        counts.wrong++;
+        std::cerr << (ready ? "ready" : "not ready") << " at " << cut
+                  << " of\n"
+                  << document << std::endl;
+      }
+      judged = !asked;
+    });
+    if (events != expected) {
+      counts.wrong++;
+      std::cerr << "other events when cut at " << cut << " of\n"
+                << document << std::endl;
+    }
+  }
+}
+} // namespace
+
+// Checks async::next_event_buffered against the parser itself, over random
+// documents cut in two at every offset, in each error and namespace mode
+// and with tight limits, and the events against those of an uncut parse.
+int main(int argc, char *argv[]) {
+  std::mt19937 random(argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1);
+  std::size_t documents =
+      argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 300;
+
+  parse_limits tight{.max_depth = 2,
+                     .max_attributes = 2,
+                     .max_name_length = 8,
+                     .max_nodes = 4};
+  constexpr auto recover = config::error_handling::recover;
+  results counts;
+  for (std::size_t i = 0; i < documents; ++i) {
+    std::string document;
+    bool rooted = random() % 2;
+    document += rooted ? "<r>" : "";
+    for (auto n = random() % 12 + 1; n > 0; --n) {
+      if (random() % 10 == 0) {
+        document += static_cast<char>(random() % 95 + 32);
+      } else {
+        document += pieces[random() % std::size(pieces)];
+      }
+    }
+    document += rooted ? "</r>" : "";
+
+    auto limits = random() % 2 ? tight : parse_limits{};
+    check_splits<config{}>(document, limits, counts);
+    check_splits<config{.on_error = recover}>(document, limits, counts);
+    check_splits<config{.process_namespaces = true}>(document, limits,
+                                                     counts);
+    check_splits<config{.process_namespaces = true, .on_error = recover}>(
+        document, limits, counts);
+  }
+  std::cout << counts.checks << " checks, " << counts.wrong << " wrong"
+            << std::endl;
+  return counts.wrong == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
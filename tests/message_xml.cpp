@@ -0,0 +1,95 @@
+#include "message_parser.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <variant>
+#include <vector>
+
+using namespace xml;
+
+namespace {
+// Small documents shaped like what a message bus carries
+std::vector<std::string> make_messages(std::size_t count) {
+  constexpr std::string_view sides[] = {"buy", "sell"};
+  std::vector<std::string> messages;
+  messages.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    auto n = std::to_string(i);
+    messages.push_back("<order id=\"" + n + "\" side=\"" +
+                       std::string{sides[i % 2]} + "\"><symbol>S" +
+                       std::to_string(i % 97) + "</symbol><qty>" +
+                       std::to_string(i % 1000 + 1) + "</qty><price>" + n +
+                       ".25</price><note/></order>");
+  }
+  return messages;
+}
+
+struct counter {
+  std::size_t events{0};
+  std::size_t text_bytes{0};
+
+  template <class E> void operator()(const E &ev) {
+    events++;
+    if constexpr (std::is_same_v<E, tag_content>) {
+      text_bytes += ev.content.size();
+    }
+  }
+};
+
+template <class F> double milliseconds(F &&f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+} // namespace
+
+// Parses many small messages, once with a new stream, context and parser
+// for each and once with a message_parser reused for all, and compares
+int main(int argc, char *argv[]) {
+  std::size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+  auto messages = make_messages(count);
+
+  counter fresh, reused;
+  std::size_t fresh_failed = 0, reused_failed = 0;
+  auto fresh_time = milliseconds([&] {
+    for (auto &message : messages) {
+      auto stream = read_string(message);
+      context ctx;
+      auto parser = parse_xml<config{}>(stream, ctx);
+      while (parser) {
+        std::visit(fresh, parser.event());
+      }
+      fresh_failed += ctx.error.has_value();
+    }
+  });
+  auto reused_time = milliseconds([&] {
+    message_parser<config{}> parser;
+    for (auto &message : messages) {
+      auto &events = parser.parse(message);
+      while (events) {
+        std::visit(reused, events.event());
+      }
+      reused_failed += parser.ctx().error.has_value();
+    }
+  });
+
+  auto rate = [&](double ms) {
+    return static_cast<std::size_t>(count / (ms / 1000));
+  };
+  std::cout << count << " messages, " << reused.events << " events, "
+            << reused.text_bytes << " bytes of text\n"
+            << "fresh:  " << fresh_time << " ms, " << rate(fresh_time)
+            << " messages/s\n"
+            << "reused: " << reused_time << " ms, " << rate(reused_time)
+            << " messages/s" << std::endl;
+  if (fresh.events != reused.events || fresh.text_bytes != reused.text_bytes ||
+      fresh_failed != reused_failed) {
+    std::cerr << "the two paths disagree" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return reused_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
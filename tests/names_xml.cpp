@@ -0,0 +1,75 @@
+#include "xml.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+using namespace xml;
+
+namespace {
+// Whether every name below `xml` has the id `table` gives it
+bool ids_agree(const tag &xml, const name_table &table) {
+  if (!xml.name.empty() && table.name(xml.id) != xml.name) {
+    return false;
+  }
+  for (auto &attr : xml.attributes) {
+    if (table.name(attr.id) != attr.name) {
+      return false;
+    }
+  }
+  for (auto &child : xml.children) {
+    if (!ids_agree(child, table)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::optional<tag> build(std::string_view document, name_table &names) {
+  context ctx;
+  ctx.names = &names;
+  auto stream = read_string(document);
+  return build_xml_doc(stream, ctx);
+}
+} // namespace
+
+// Builds FILE twice with name tables stacked on a shared base that knows the
+// names every document starts with, and checks that both agree with the base
+// and with each other. Then checks that end tags are matched by id.
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: names_xml <FILE>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto base = std::make_shared<const name_table>(
+      std::initializer_list<std::string_view>{"root", "item", "id"});
+
+  name_table first{base}, second{base};
+  context ctx;
+  ctx.names = &first;
+  auto stream = slurp_file(argv[1]);
+  auto doc = build_xml_doc(stream, ctx);
+  if (!doc) {
+    std::cerr << "failed at " << ctx.error->offset << ": "
+              << ctx.error->reason << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto again = build(R"(<root><item id="1"/><other/></root>)", second);
+  if (!ids_agree(*doc, first) || !again || !ids_agree(*again, second) ||
+      again->children[0].id != base->find("root") ||
+      second.find("other") != base->size() || base->find("other") != no_name) {
+    std::cerr << "the names didn't get the ids of their tables" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (build("<root><item></root></item>", second) ||
+      !build("<root><new></new></root>", second)) {
+    std::cerr << "end tags weren't matched by id" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << first.size() << " names in " << argv[1] << ", "
+            << base->size() << " of them shared" << std::endl;
+}
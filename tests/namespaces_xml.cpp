@@ -0,0 +1,94 @@
+#include "xml.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <variant>
+
+using namespace xml;
+
+namespace {
+constexpr std::string_view document =
+    R"(<feed xmlns="urn:atom" xmlns:m="urn:media">
+  <entry m:id="1" plain="x">
+    <m:thumb xmlns:m="urn:other" m:size="s"/>
+    <title xmlns="">t</title>
+    <m:player/>
+  </entry>
+</feed>)";
+
+// Every element, then its attributes, as "name (local) in URI"
+constexpr std::string_view expected =
+    "feed (feed) in urn:atom\n"
+    "  xmlns in http://www.w3.org/2000/xmlns/\n"
+    "  xmlns:m in http://www.w3.org/2000/xmlns/\n"
+    "entry (entry) in urn:atom\n"
+    "  m:id in urn:media\n"
+    "  plain\n"
+    "m:thumb (thumb) in urn:other\n"
+    "  xmlns:m in http://www.w3.org/2000/xmlns/\n"
+    "  m:size in urn:other\n"
+    "title (title)\n"
+    "  xmlns in http://www.w3.org/2000/xmlns/\n"
+    "m:player (player) in urn:media\n";
+
+std::string in(const name_table &names, name_id ns) {
+  return ns == no_name ? "" : " in " + std::string{names.name(ns)};
+}
+
+void describe_tree(const tag &xml, const name_table &names, std::string &out) {
+  if (!xml.name.empty()) {
+    out += xml.name + " (" + std::string{local_name(xml.name)} + ")" +
+           in(names, xml.ns) + '\n';
+    for (auto &attr : xml.attributes) {
+      out += "  " + attr.name + in(names, attr.ns) + '\n';
+    }
+  }
+  for (auto &child : xml.children) {
+    describe_tree(child, names, out);
+  }
+}
+} // namespace
+
+// Resolves the namespaces of a document with default and prefixed
+// declarations, some of them overridden or undone further in, both while
+// parsing and over the built tree, and checks both against what they should
+// be
+int main() {
+  name_table names;
+  context ctx;
+  ctx.names = &names;
+
+  std::string events;
+  auto stream = read_string(document);
+  auto parser = parse_xml<config{.process_namespaces = true}>(stream, ctx);
+  while (parser) {
+    auto event = parser.event();
+    if (auto *open = std::get_if<tag_open>(&event)) {
+      events += std::string{open->name} + " (" + std::string{open->local} +
+                ")" + in(names, open->ns) + '\n';
+    } else if (auto *attr = std::get_if<tag_attribute>(&event)) {
+      events += "  " + std::string{attr->key} + in(names, attr->ns) + '\n';
+    }
+  }
+  if (ctx.error || events != expected) {
+    std::cerr << "the parser resolved\n" << events;
+    return EXIT_FAILURE;
+  }
+
+  auto again = read_string(document);
+  auto doc = build_xml_doc(again, ctx);
+  if (!doc) {
+    std::cerr << "the document didn't build" << std::endl;
+    return EXIT_FAILURE;
+  }
+  resolve_namespaces(*doc, ctx);
+  std::string tree;
+  describe_tree(*doc, names, tree);
+  if (tree != expected) {
+    std::cerr << "the tree resolved\n" << tree;
+    return EXIT_FAILURE;
+  }
+  std::cout << events;
+}
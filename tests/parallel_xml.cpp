@@ -0,0 +1,111 @@
+#include "hash.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace xml;
+
+namespace {
+template <class F> double milliseconds(F &&f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Stands for per node work worth spreading: a checksum of the node
+std::uint64_t node_hash(const tag &node) {
+  auto h = fast_hash(node.name.data(), node.name.size());
+  for (auto &a : node.attributes) {
+    h ^= fast_hash(a.value.data(), a.value.size(), h);
+  }
+  return h ^ fast_hash(node.content.data(), node.content.size(), h);
+}
+
+// One per thread, each on its own cache line
+struct alignas(64) partial_sum {
+  std::uint64_t value{0};
+};
+
+void serial_walk(tag &node, auto &&f) {
+  f(node);
+  for (auto &child : node.children) {
+    serial_walk(child, f);
+  }
+}
+} // namespace
+
+// Hashes every node, counts the elements with a given name and upper-cases
+// all text, on one thread and then on a task_pool, and checks that both
+// agree
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: parallel_xml <FILE> <NAME> [THREADS]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string_view name = argv[2];
+  task_pool pool{argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 0};
+
+  auto stream = slurp_file(argv[1]);
+  auto doc = build_xml_doc(stream);
+  if (!doc) {
+    std::cerr << "parse failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::uint64_t serial_sum = 0;
+  std::size_t serial_count = 0;
+  auto serial_time = milliseconds([&] {
+    serial_walk(*doc, [&](tag &node) { serial_sum += node_hash(node); });
+    serial_walk(*doc, [&](tag &node) { serial_count += node.name == name; });
+  });
+
+  std::vector<partial_sum> sums(pool.size());
+  std::size_t count = 0;
+  auto parallel_time = milliseconds([&] {
+    parallel_for_each(pool, *doc, [&](const tag &node, std::size_t thread) {
+      sums[thread].value += node_hash(node);
+    });
+    count = parallel_map_reduce(
+        pool, *doc, name, std::size_t{0}, [](const tag &) { return 1; },
+        [](std::size_t a, std::size_t b) { return a + b; });
+  });
+  std::uint64_t sum = 0;
+  for (auto &s : sums) {
+    sum += s.value;
+  }
+
+  auto upper = [](tag &node) {
+    std::ranges::transform(node.content, node.content.begin(), [](char c) {
+      return static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    });
+  };
+  auto copy = *doc;
+  auto serial_transform_time = milliseconds([&] { serial_walk(copy, upper); });
+  auto transform_time =
+      milliseconds([&] { parallel_transform(pool, *doc, upper); });
+  std::uint64_t transformed = 0, expected = 0;
+  parallel_for_each(pool, *doc, [&](const tag &node) {
+    std::atomic_ref{transformed}.fetch_add(node_hash(node));
+  });
+  serial_walk(copy, [&](tag &node) { expected += node_hash(node); });
+
+  std::cout << serial_count << " <" << name << "> elements, checksum "
+            << std::hex << sum << std::dec << '\n';
+  std::cout << "1 thread:   " << serial_time << " ms, transform "
+            << serial_transform_time << " ms\n";
+  std::cout << pool.size() << " threads: " << parallel_time
+            << " ms, transform " << transform_time << " ms" << std::endl;
+  if (sum != serial_sum || count != serial_count || transformed != expected) {
+    std::cerr << "parallel results differ" << std::endl;
+    return EXIT_FAILURE;
+  }
+}
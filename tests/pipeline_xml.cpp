@@ -0,0 +1,59 @@
+#include "pipeline.hpp"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <unistd.h>
+#include <variant>
+
+using namespace xml;
+
+// Counts elements by name, parsing and counting on separate threads
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: pipeline_xml <FILE> [CONSUMERS]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  int fd = ::open(argv[1], O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "cannot open " << argv[1] << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  constexpr config cfg{.emit_tag_attribute = false, .emit_tag_content = false};
+  std::mutex mutex;
+  std::map<std::string, std::size_t> counts;
+
+  context ctx;
+  bool ok = run_pipeline<cfg>(
+      fd,
+      [&](const event_batch<cfg> &batch) {
+        std::map<std::string_view, std::size_t> local;
+        for (auto &event : batch.events) {
+          if (auto *open = std::get_if<tag_open>(&event)) {
+            local[open->name]++;
+          }
+        }
+        std::lock_guard lock{mutex};
+        for (auto [name, n] : local) {
+          counts[std::string{name}] += n;
+        }
+      },
+      ctx, {.consumers = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1});
+  ::close(fd);
+
+  for (auto &[name, n] : counts) {
+    std::cout << name << ": " << n << '\n';
+  }
+  if (!ok) {
+    std::cerr << "failed";
+    if (ctx.error) {
+      std::cerr << " at " << ctx.error->offset << ": " << ctx.error->reason;
+    }
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,51 @@
+#include "xml.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+using namespace xml;
+
+namespace {
+constexpr std::string_view document = "<r>\n"
+                                      "  two  words\n"
+                                      "  <![CDATA[ kept   as\n<is>]]>\n"
+                                      "  <c/>\ttail\t\tend \n"
+                                      "</r>";
+
+std::string content(bool raw_text) {
+  context ctx;
+  ctx.raw_text = raw_text;
+  auto stream = read_string(document);
+  auto doc = build_xml_doc(stream, ctx);
+  return doc ? doc->children[0].content : "no document";
+}
+
+std::string collapsed(std::string_view text) {
+  std::string out = "[";
+  append_collapsed(out, text);
+  return out + ']';
+}
+} // namespace
+
+// Builds a document with text around a CDATA section and a child element,
+// once with its text collapsed and once as written, and checks both. The
+// CDATA section is kept as is either way.
+int main() {
+  auto as_written = content(true), as_collapsed = content(false);
+  if (as_written != "\n  two  words\n   kept   as\n<is>\n  \ttail\t\tend \n") {
+    std::cerr << "raw text was '" << as_written << "'" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (as_collapsed != "two words kept   as\n<is> tail end") {
+    std::cerr << "collapsed text was '" << as_collapsed << "'" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (collapsed("a b") != "[a b]" || collapsed("  a \t\n b  ") != "[ a b]" ||
+      collapsed(" \n ") != "[]" || collapsed("") != "[]") {
+    std::cerr << "runs of blanks weren't collapsed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << as_collapsed << std::endl;
+}
@@ -0,0 +1,157 @@
+#include "sax.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+
+using namespace xml;
+
+namespace {
+constexpr config recovering{.process_namespaces = true,
+                            .on_error = config::error_handling::recover};
+
+// One line per event, with the namespace URI of elements that have one
+struct describer {
+  std::string &out;
+  const context &ctx;
+
+  void element(std::string_view kind, std::string_view name, name_id ns) {
+    out += std::string{kind} + ' ' + std::string{name};
+    if (ns != no_name) {
+      out += " in " + std::string{ctx.namespaces.uris.name(ns)};
+    }
+    out += '\n';
+  }
+
+  void on_tag_open(const tag_open &e) { element("open", e.name, e.ns); }
+  void on_tag_close(const tag_close &e) { element("close", e.name, e.ns); }
+  void on_tag_self_close() { out += "self close\n"; }
+  void on_attribute(const tag_attribute &e) {
+    out += "attribute " + std::string{e.key} + '\n';
+  }
+  void on_content(const tag_content &e) {
+    out += "text " + std::string{e.content} + '\n';
+  }
+  void on_error(const parse_error &e) {
+    out += "error " + std::string{e.reason} + '\n';
+  }
+};
+
+struct recovery {
+  std::string_view input;
+  std::string_view events;
+};
+
+constexpr recovery recoveries[] = {
+    // the end tag of a broken start tag closes nothing
+    {"<a><b x=1>t</b><c/></a>", "open a\n"
+                                "open b\n"
+                                "error expected '\"' before attribute value\n"
+                                "error closing tag without an opening one\n"
+                                "open c\n"
+                                "self close\n"
+                                "close a\n"},
+    // an end tag further out closes what's inside it first
+    {"<a><b><c>t</b>u</a>", "open a\n"
+                            "open b\n"
+                            "open c\n"
+                            "text t\n"
+                            "error mismatched closing tag\n"
+                            "close c\n"
+                            "close b\n"
+                            "text u\n"
+                            "close a\n"},
+    // end tags of nothing, in an element and after the root
+    {"<a>x</b>y</a></a><d/>", "open a\n"
+                              "text x\n"
+                              "error closing tag without an opening one\n"
+                              "text y\n"
+                              "close a\n"
+                              "error closing tag without an opening one\n"
+                              "open d\n"
+                              "self close\n"},
+    // the namespace scopes of the elements closed early go with them
+    {"<a xmlns:p=\"u\"><b xmlns:p=\"v\"><p:c></b><p:d/></a>",
+     "open a\n"
+     "attribute xmlns:p\n"
+     "open b\n"
+     "attribute xmlns:p\n"
+     "open p:c in v\n"
+     "error mismatched closing tag\n"
+     "close p:c in v\n"
+     "close b\n"
+     "open p:d in u\n"
+     "self close\n"
+     "close a\n"},
+};
+
+// The events of `input` in recover mode, from the event parser or from
+// sax_parse, followed by where the parse ended up
+template <bool Sax> std::string recover(std::string_view input) {
+  std::string out;
+  context ctx;
+  describer describe{out, ctx};
+  auto stream = read_string(input);
+  if constexpr (Sax) {
+    sax_parse<recovering>(stream, describe, ctx);
+  } else {
+    auto parser = parse_xml<recovering>(stream, ctx);
+    while (parser) {
+      std::visit(
+          [&]<class E>(const E &e) {
+            if constexpr (std::is_same_v<E, tag_open>) {
+              describe.on_tag_open(e);
+            } else if constexpr (std::is_same_v<E, tag_close>) {
+              describe.on_tag_close(e);
+            } else if constexpr (std::is_same_v<E, tag_self_close>) {
+              describe.on_tag_self_close();
+            } else if constexpr (std::is_same_v<E, tag_attribute>) {
+              describe.on_attribute(e);
+            } else if constexpr (std::is_same_v<E, tag_content>) {
+              describe.on_content(e);
+            } else if constexpr (std::is_same_v<E, parse_error>) {
+              describe.on_error(e);
+            }
+          },
+          parser.event());
+    }
+  }
+  if (ctx.depth != 0 || ctx.elements.size() != 0) {
+    out += "still open\n";
+  }
+  return out;
+}
+} // namespace
+
+// Parses broken documents in recover mode and checks that end tags close the
+// element they name, both with the event parser and with sax_parse, and that
+// without recovering a mismatched end tag fails the parse
+int main() {
+  for (auto &r : recoveries) {
+    for (auto events : {recover<false>(r.input), recover<true>(r.input)}) {
+      if (events != r.events) {
+        std::cerr << "recovering from " << r.input << " gave\n"
+                  << events << "instead of\n"
+                  << r.events;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  context ctx;
+  auto stream = read_string("<a><b></a></b>");
+  auto parser = parse_xml<config{}>(stream, ctx);
+  while (parser) {
+    parser.event();
+  }
+  if (!ctx.error || ctx.error->reason != "mismatched closing tag") {
+    std::cerr << "a mismatched closing tag was accepted" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << std::size(recoveries) << " broken documents recovered"
+            << std::endl;
+}
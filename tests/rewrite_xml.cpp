@@ -0,0 +1,32 @@
+#include "char_stream.hpp"
+#include "writer.hpp"
+#include "xml.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include <variant>
+
+using namespace xml;
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: rewrite_xml <FILE> [--pretty]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto f = slurp_file(argv[1]);
+
+  buffered_writer out{STDOUT_FILENO};
+  writer w{out, {
+                    .pretty = argc > 2 && strcmp(argv[2], "--pretty") == 0,
+                    .escape = false,
+                }};
+
+  auto parser = parse_xml<config{.emit_comments = true}>(f);
+  while (parser) {
+    std::visit(w, parser.event());
+  }
+  out.put('\n');
+
+  return out.flush() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
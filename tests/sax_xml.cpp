@@ -0,0 +1,144 @@
+#include "sax.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <variant>
+#include <vector>
+
+using namespace xml;
+
+namespace {
+struct counts {
+  std::size_t elements{0};
+  std::size_t attributes{0};
+  std::size_t text_bytes{0};
+
+  bool operator==(const counts &) const = default;
+};
+
+struct counting_handler {
+  counts &result;
+
+  void on_tag_open(const tag_open &) { result.elements++; }
+  void on_attribute(const tag_attribute &) { result.attributes++; }
+  void on_content(const tag_content &ev) {
+    result.text_bytes += ev.content.size();
+  }
+};
+
+struct error_handler {
+  std::vector<parse_error> &errors;
+
+  void on_error(const parse_error &e) { errors.push_back(e); }
+};
+
+// Invalid UTF-8 in recover mode: both interfaces report it once, where the
+// valid input ends
+bool malformed_input_agrees() {
+  constexpr config checked{.validate_utf8 = true,
+                           .on_error = config::error_handling::recover};
+  std::string_view data = "<a><b>x\xff y</b><c/></a>";
+
+  std::vector<parse_error> sax, events;
+  {
+    auto stream = read_string(data);
+    sax_parse<checked>(stream, error_handler{sax});
+  }
+  {
+    auto stream = read_string(data);
+    auto parser = parse_xml<checked>(stream);
+    while (parser) {
+      if (auto event = parser.event();
+          auto error = std::get_if<parse_error>(&event)) {
+        events.push_back(*error);
+      }
+    }
+  }
+  auto once = [](const std::vector<parse_error> &errors) {
+    return errors.size() == 1 && errors[0].offset == 7;
+  };
+  return once(sax) && once(events);
+}
+
+std::string read_all(const char *path) {
+  std::string data;
+  auto stream = slurp_file(path);
+  while (stream) {
+    data.append(stream.consume(1 << 16));
+  }
+  return data;
+}
+
+template <class F> double milliseconds(F &&f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+} // namespace
+
+// Counts elements, attributes and text with the callback interface and with
+// the event parser, and compares how long each takes
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: sax_xml <FILE>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!malformed_input_agrees()) {
+    std::cerr << "invalid UTF-8 isn't reported once" << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto data = read_all(argv[1]);
+
+  counts sax, events, checked;
+  context sax_ctx, events_ctx, checked_ctx;
+  auto sax_time = milliseconds([&] {
+    auto stream = read_string(data);
+    sax_parse(stream, counting_handler{sax}, sax_ctx);
+  });
+  auto checked_time = milliseconds([&] {
+    auto stream = read_string(data);
+    sax_parse<config{.validate_utf8 = true}>(stream, counting_handler{checked},
+                                             checked_ctx);
+  });
+  auto events_time = milliseconds([&] {
+    auto stream = read_string(data);
+    auto parser = parse_xml<config{}>(stream, events_ctx);
+    while (parser) {
+      std::visit(
+          [&]<class E>(const E &ev) {
+            if constexpr (std::is_same_v<E, tag_open>) {
+              events.elements++;
+            } else if constexpr (std::is_same_v<E, tag_attribute>) {
+              events.attributes++;
+            } else if constexpr (std::is_same_v<E, tag_content>) {
+              events.text_bytes += ev.content.size();
+            }
+          },
+          parser.event());
+    }
+  });
+
+  std::cout << sax.elements << " elements, " << sax.attributes
+            << " attributes, " << sax.text_bytes << " bytes of text\n"
+            << "callbacks: " << sax_time << " ms\n"
+            << "  + UTF-8: " << checked_time << " ms\n"
+            << "events:    " << events_time << " ms" << std::endl;
+  if (sax_ctx.error) {
+    std::cerr << "failed at " << sax_ctx.error->offset << ": "
+              << sax_ctx.error->reason << std::endl;
+  }
+  if (checked_ctx.error && !sax_ctx.error) {
+    std::cerr << "invalid UTF-8 at " << checked_ctx.error->offset
+              << std::endl;
+  }
+  if (!(sax == events) ||
+      sax_ctx.error.has_value() != events_ctx.error.has_value()) {
+    std::cerr << "the two interfaces disagree" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return sax_ctx.error ? EXIT_FAILURE : EXIT_SUCCESS;
+}
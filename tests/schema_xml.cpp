@@ -0,0 +1,117 @@
+#include "schema.hpp"
+#include "xml.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+using namespace xml;
+
+namespace {
+using known = schema<"java", "javaInfo", "vendor", "version", "location",
+                     "xsi:nil">;
+
+// In the order of the schema, then one for everything else
+enum class known_name {
+  java,
+  java_info,
+  vendor,
+  version,
+  location,
+  nil,
+  other
+};
+
+static_assert(known::lookup("javaInfo") == 1);
+static_assert(known::lookup("features") == no_name);
+static_assert(known::recognize<known_name>("vendor") == known_name::vendor);
+static_assert(known::recognize<known_name>("features") == known_name::other);
+
+constexpr config recognized{.recognize_names = &known::recognizer};
+
+// "name10" to "name99"
+template <std::size_t I> constexpr fixed_string<7> numbered() {
+  static_assert(I >= 10 && I < 100);
+  char name[] = "name00";
+  name[4] = static_cast<char>('0' + I / 10);
+  name[5] = static_cast<char>('0' + I % 10);
+  return name;
+}
+
+// Whether every name of a schema of numbered names gets its own position
+template <std::size_t First, std::size_t... I>
+constexpr bool numbered_schema_works(std::index_sequence<I...>) {
+  using numbered_schema = schema<numbered<First + I>()...>;
+  return ((numbered_schema::lookup(numbered<First + I>().view()) == I) &&
+          ...) &&
+         numbered_schema::lookup("name") == no_name &&
+         numbered_schema::lookup("other") == no_name;
+}
+
+// Every run of Size consecutive numbered names
+template <std::size_t Size, std::size_t... First>
+constexpr bool numbered_windows_work(std::index_sequence<First...>) {
+  return (numbered_schema_works<10 + First>(std::make_index_sequence<Size>{}) &&
+          ...);
+}
+
+// The first names, as many as each Size
+template <std::size_t... Size> constexpr bool numbered_prefixes_work() {
+  return (numbered_schema_works<10>(std::make_index_sequence<Size>{}) && ...);
+}
+
+// Names that share a bucket used to collide on every displacement
+static_assert(numbered_schema_works<18>(std::make_index_sequence<6>{}));
+static_assert(numbered_windows_work<6>(std::make_index_sequence<85>{}));
+static_assert(numbered_prefixes_work<1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31,
+                                     32, 33, 64, 90>());
+} // namespace
+
+// Counts the element and attribute names of FILE that are in a compile-time
+// schema, and checks that every name gets the same id from the schema and
+// from the name table that takes over for the names outside it
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: schema_xml <FILE>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto table = known::make_table();
+  context ctx;
+  ctx.names = &table;
+
+  std::array<std::size_t, known::size + 1> counts{};
+  bool agree = true;
+  auto count = [&](std::string_view name, name_id id) {
+    counts[static_cast<std::size_t>(known::recognize<known_name>(name))]++;
+    agree = agree && id != no_name && table.name(id) == name &&
+            (id < known::size) == (known::lookup(name) != no_name);
+  };
+  auto stream = slurp_file(argv[1]);
+  auto parser = parse_xml<recognized>(stream, ctx);
+  while (parser) {
+    auto ev = parser.event();
+    if (auto *open = std::get_if<tag_open>(&ev)) {
+      count(open->name, open->id);
+    } else if (auto *attr = std::get_if<tag_attribute>(&ev)) {
+      count(attr->key, attr->id);
+    }
+  }
+  if (ctx.error) {
+    std::cerr << "failed at " << ctx.error->offset << ": "
+              << ctx.error->reason << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  for (std::size_t i = 0; i < known::size; ++i) {
+    std::cout << known::names[i] << ": " << counts[i] << '\n';
+  }
+  std::cout << "others: " << counts[known::size] << ", "
+            << table.size() - known::size << " other names" << std::endl;
+  if (!agree) {
+    std::cerr << "the schema and the name table disagree" << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,89 @@
+#include "snapshot.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+using namespace xml;
+
+namespace {
+bool same_tree(const tag &a, const tag &b) {
+  if (a.name != b.name || a.id != b.id || a.content != b.content ||
+      a.attributes.size() != b.attributes.size() ||
+      a.children.size() != b.children.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < a.attributes.size(); ++i) {
+    auto &x = a.attributes[i];
+    auto &y = b.attributes[i];
+    if (x.name != y.name || x.id != y.id || x.value != y.value) {
+      return false;
+    }
+  }
+  for (std::size_t i = 0; i < a.children.size(); ++i) {
+    if (!same_tree(a.children[i], b.children[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Points the children of the root past the end of the node table
+bool corrupt(const char *path) {
+  int fd = ::open(path, O_WRONLY);
+  if (fd < 0) {
+    return false;
+  }
+  auto past_end = static_cast<std::uint32_t>(-1);
+  auto offset = sizeof(snapshot_format::header) +
+                offsetof(snapshot_format::node, first_child);
+  bool ok = ::pwrite(fd, &past_end, sizeof(past_end), offset) ==
+            static_cast<ssize_t>(sizeof(past_end));
+  return ::close(fd) == 0 && ok;
+}
+} // namespace
+
+// Saves FILE as a snapshot in SNAPSHOT, opens it again and checks that it
+// copies back to the same tree, name ids included. Then damages the file
+// and checks that opening it without the checksum still refuses it.
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: snapshot_xml <FILE> <SNAPSHOT>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto stream = slurp_file(argv[1]);
+  name_table names;
+  context ctx;
+  ctx.names = &names;
+  auto doc = build_xml_doc(stream, ctx);
+  if (!doc) {
+    std::cerr << "parse failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!save_snapshot(*doc, argv[2])) {
+    std::cerr << "cannot write " << argv[2] << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  auto snap = snapshot::open(argv[2]);
+  if (!snap) {
+    std::cerr << "cannot open " << argv[2] << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!same_tree(snap->root().to_tag(&names), *doc)) {
+    std::cerr << "the snapshot doesn't copy back to the document"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << snap->node_count() << " nodes, " << names.size()
+            << " names" << std::endl;
+
+  if (!corrupt(argv[2]) || snapshot::open(argv[2], false)) {
+    std::cerr << "a damaged snapshot was opened" << std::endl;
+    return EXIT_FAILURE;
+  }
+}
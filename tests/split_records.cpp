@@ -0,0 +1,77 @@
+#include "split.hpp"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace xml;
+
+// Splits FILE into SHARDS documents named PREFIX-<i>.xml, each holding a run
+// of the children of the root element
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: split_records <FILE> <SHARDS> [PREFIX]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::size_t count = std::strtoul(argv[2], nullptr, 10);
+  std::string prefix = argc > 3 ? argv[3] : "shard";
+  if (count == 0) {
+    std::cerr << "SHARDS must be at least 1" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int fd = ::open(argv[1], O_RDONLY);
+  struct stat st;
+  if (fd < 0 || ::fstat(fd, &st) != 0) {
+    std::cerr << "cannot open " << argv[1] << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto size = static_cast<std::size_t>(st.st_size);
+  void *mapping = size == 0
+                      ? nullptr
+                      : ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    std::cerr << "cannot map " << argv[1] << std::endl;
+    return EXIT_FAILURE;
+  }
+  ::madvise(mapping, size, MADV_SEQUENTIAL);
+  std::string_view document{static_cast<const char *>(mapping), size};
+
+  auto layout = find_records(document);
+  if (layout.error) {
+    std::cerr << "cannot split at " << layout.error->offset << ": "
+              << layout.error->reason << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto cuts = cut_records(layout, count);
+
+  std::vector<int> outputs;
+  for (std::size_t i = 0; i + 1 < cuts.size(); ++i) {
+    auto path = prefix + "-" + std::to_string(i) + ".xml";
+    int out = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+      std::cerr << "cannot create " << path << std::endl;
+      return EXIT_FAILURE;
+    }
+    outputs.push_back(out);
+  }
+  bool ok = write_shards(document, layout, cuts, outputs);
+  for (int out : outputs) {
+    ok = ::close(out) == 0 && ok;
+  }
+  ::munmap(mapping, size);
+
+  std::cout << layout.record_ends.size() << " records in " << outputs.size()
+            << " shards" << std::endl;
+  if (!ok) {
+    std::cerr << "writing the shards failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}